@@ -1,20 +1,21 @@
 %% Gennerate jamming wav
 clear all;
-wavelen = 48000*5*60; % 5 mins
+fs = 48000; % the sample rate the sound card plays it at
+wavelen = fs*5*60; % 5 mins
 wav = 2*(rand(1,wavelen)-0.5)*32767; % random noise
 wav = int16(wav);
-mask = zeros(1,length(wav)+200*48); % mask to generate quiet period
+mask = zeros(1,length(wav)+200*fs/1000); % mask to generate quiet period
 i=1;
 flag = 0;
 while(i<length(wav))
     
     if flag == 0
-        duration = int32((100+rand(1)*100)*48); % 0.1s to 0.2s quiet
+        duration = int32((100+rand(1)*100)*fs/1000); % 0.1s to 0.2s quiet
 %         mask(i:i+duration-1) = 0;
         i = i+duration;
         flag = 1;
     else
-        duration = int32((50+rand(1)*50)*48); % 0.05s to 0.1s noisy
+        duration = int32((50+rand(1)*50)*fs/1000); % 0.05s to 0.1s noisy
         mask(i:i+duration-1) = 1;
         i = i+duration;
         flag = 0;
@@ -25,7 +26,7 @@ mask = int16(mask(1:length(wav)));
 
 
 jammingwav = mask.*wav;
-plot(0:1/48000:5*60-1/48000,jammingwav);
-% sound(double(jammingwav)/32767, 48000)
+plot(0:1/fs:5*60-1/fs,jammingwav);
+% sound(double(jammingwav)/32767, fs)
 
-audiowrite('Jamming.wav',jammingwav,48000);
\ No newline at end of file
+audiowrite('Jamming.wav',jammingwav,fs);
\ No newline at end of file
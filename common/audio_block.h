@@ -0,0 +1,164 @@
+#pragma once
+
+#include "capture.h"
+#include "dsp.h"
+#include "link_config.h"
+#include "ring.h"
+#include "rtcheck.h"
+#include "scheduler.h"
+#include "stats.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Which channels carry the link, read from the device in prepareToPlay so the callback never asks it
+struct ChannelLayout {
+    int numOutputs = 0;
+    uint64_t linked = 0; // bit c: channel c is active for input and output
+
+    void update(AudioIODevice *device) {
+        numOutputs = 0;
+        linked = 0;
+        if (device == nullptr) return;
+        auto activeInputChannels = device->getActiveInputChannels();
+        auto activeOutputChannels = device->getActiveOutputChannels();
+        auto maxInputChannels = activeInputChannels.getHighestBit() + 1;
+        numOutputs = std::min(activeOutputChannels.getHighestBit() + 1, 64);
+        for (int channel = 0; maxInputChannels > 0 && channel < numOutputs; ++channel)
+            if (activeInputChannels[channel] && activeOutputChannels[channel]) linked |= uint64_t(1) << channel;
+    }
+
+    [[nodiscard]] bool isLinked(int channel) const { return linked >> channel & 1; }
+
+    // Link lanes the device can carry, at least one
+    [[nodiscard]] unsigned lanes() const {
+        unsigned ret = 0;
+        for (auto bits = linked; bits != 0; bits &= bits - 1) ++ret;
+        return std::clamp(ret, 1u, MAX_LANES);
+    }
+};
+
+// How the audio callback decides the channel is busy, see LinkConfig
+struct CarrierSense {
+    int window = 0;        // samples at the end of every block
+    float threshold = 0;   // absolute
+    float noiseMargin = 0; // relative to the noise floor
+    float floorRise = 0;   // per block
+    float dcPole = 0.995f;
+};
+
+/* The audio callback of Part3 - Part5
+ *
+ * Only touches preallocated rings and atomics: the input goes to the receiver ring, carrier sense
+ * goes to quiet, and whatever the Writer scheduled is played at its sample. Nothing here blocks or allocates.
+ *
+ * The link runs at the sample rate of its configuration, the device at whatever it was opened
+ * with. When setRates() says they differ, the input is resampled to the link rate before anything
+ * looks at it and the output from it afterwards (dsp::Resampler), so the rings, carrier sense,
+ * the capture and the output clock all count link samples.
+ *
+ * Carrier sense DC-blocks the input and compares the peak of the last quietWindow samples with
+ * both an absolute threshold and a multiple of the noise floor, the quietest such peak seen lately,
+ * so a louder background or a DC offset do not keep the channel busy forever.
+ */
+class LinkAudioBlock {
+public:
+    LinkAudioBlock(SampleRing &inputRing, OutputScheduler &outputScheduler, Atomic<bool> &quietFlag,
+                   LinkStats &linkStats, AudioCapture &audioCapture) :
+            input(inputRing), output(outputScheduler), quiet(quietFlag), stats(linkStats), capture(audioCapture) {}
+
+    void configure(const CarrierSense &settings) {
+        quietWindow = settings.window;
+        noisyThreshold = settings.threshold;
+        noiseMargin = settings.noiseMargin;
+        noiseFloor = dsp::FloorTracker(settings.floorRise);
+        dcBlocker = dsp::DcBlocker(settings.dcPole);
+    }
+
+    // Resamples between the device and the link from now on if their rates differ; the device hands
+    // process() up to maxBlock samples at once. Call it before the audio starts.
+    void setRates(double deviceRate, double linkRate, int maxBlock) {
+        resampling = std::lround(deviceRate) != std::lround(linkRate);
+        spilled = 0;
+        if (!resampling) return;
+        auto device = (unsigned) std::lround(deviceRate), link = (unsigned) std::lround(linkRate);
+        toLink = std::make_unique<dsp::Resampler>(device, link);
+        toDevice = std::make_unique<dsp::Resampler>(link, device);
+        blockSize = (size_t) std::max(maxBlock, 1);
+        linkSamples.resize(std::max(toLink->outputsFor(blockSize), toDevice->inputsFor(blockSize + 1)));
+        deviceSamples.resize(blockSize + toDevice->maxOutputs());
+    }
+
+    // Audio thread only; data is read and then overwritten in place
+    void process(float *data, int bufferSize) {
+        rtcheck::RealtimeScope realtime;
+        if (!resampling) {
+            receive(data, bufferSize);
+            transmit(data, bufferSize);
+            return;
+        }
+        // a block longer than setRates() was told goes in pieces
+        for (int done = 0; done < bufferSize;) {
+            auto n = std::min((int) blockSize, bufferSize - done);
+            auto linkCount = toLink->process(data + done, (size_t) n, linkSamples.data());
+            receive(linkSamples.data(), (int) linkCount);
+            // the last link sample may complete outputs beyond this block; they are played first next time
+            if (spilled < (size_t) n) {
+                linkCount = toDevice->inputsFor((size_t) n - spilled);
+                transmit(linkSamples.data(), (int) linkCount);
+                spilled += toDevice->process(linkSamples.data(), linkCount, deviceSamples.data() + spilled);
+            }
+            std::copy(deviceSamples.begin(), deviceSamples.begin() + n, data + done);
+            std::copy(deviceSamples.begin() + n, deviceSamples.begin() + (long) spilled, deviceSamples.begin());
+            spilled -= (size_t) n;
+            done += n;
+        }
+    }
+
+private:
+    // Hands bufferSize link samples to the receiver, the capture and carrier sense
+    void receive(const float *data, int bufferSize) {
+        // Read in PHY layer
+        auto accepted = input.push(data, (size_t) bufferSize);
+        if (accepted < (size_t) bufferSize) LinkStats::add(stats.inputOverruns, bufferSize - accepted);
+        capture.push(data, bufferSize);
+        // listen if the channel is quiet
+        float peak = 0;
+        for (int i = 0, from = bufferSize - quietWindow; i < bufferSize; ++i) {
+            auto level = std::fabs(dcBlocker.processSample(data[i]));
+            if (i >= from) peak = std::max(peak, level);
+        }
+        quiet.set(peak <= std::max(noisyThreshold, noiseMargin * noiseFloor.value()));
+        LinkStats::set(stats.noiseFloorMicro, (int64_t) (noiseFloor.update(peak) * 1e6f));
+    }
+
+    // Plays the next bufferSize link samples into data
+    void transmit(float *data, int bufferSize) {
+        // Write if PHY layer wants
+        auto rendered = output.render(data, (size_t) bufferSize);
+        LinkStats::add(stats.samplesTransmitted, rendered.transmitted);
+        if (rendered.late) LinkStats::add(stats.lateTransmissions, rendered.late);
+        LinkStats::add(stats.samplesElapsed, bufferSize);
+    }
+
+    SampleRing &input;
+    OutputScheduler &output;
+    Atomic<bool> &quiet;
+    LinkStats &stats;
+    AudioCapture &capture;
+    int quietWindow{0};
+    float noisyThreshold{0};
+    float noiseMargin{0};
+    dsp::FloorTracker noiseFloor{0};
+    dsp::DcBlocker dcBlocker;
+    // Between device and link rate, only with resampling
+    bool resampling{false};
+    size_t blockSize{0};
+    std::unique_ptr<dsp::Resampler> toLink, toDevice;
+    std::vector<float> linkSamples;   // one block at the link rate, either way
+    std::vector<float> deviceSamples; // resampled output, the first spilled ones not played yet
+    size_t spilled{0};
+};
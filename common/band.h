@@ -0,0 +1,68 @@
+#pragma once
+
+#include "dsp.h"
+#include <cmath>
+#include <cstddef>
+
+/* Band split (LinkConfig BAND_SPLIT): each node transmits on a carrier band of its own
+ *
+ * The baseband samples of a frame key a carrier on for the +1 half of every bit and off for the -1
+ * half, at BAND_PERIOD_NODE1 or BAND_PERIOD_NODE2 samples per cycle depending on the sending node.
+ * The receiver band-passes the input around the carrier of the peer, which leaves out its own
+ * transmission, and rectifies and smooths what is left over one carrier cycle. That envelope is
+ * the baseband signal again, up to an offset the DC blocker takes out, so the preamble matcher and
+ * the slicer work on it unchanged. Neither node has to wait for the other: both transmit at once.
+ */
+template<class Config>
+int bandPeriod(bool isNode1) { return isNode1 ? Config::BAND_PERIOD_NODE1 : Config::BAND_PERIOD_NODE2; }
+
+// Keys the carrier of the sending node with baseband samples of +1 and -1, in place
+template<class Config>
+void keyCarrier(float *samples, size_t n, bool isNode1) {
+    auto period = bandPeriod<Config>(isNode1);
+    for (size_t i = 0; i < n; ++i)
+        samples[i] = samples[i] > 0 ? (float) std::sin(2 * M_PI * (double) (i % period) / period) : 0.0f;
+}
+
+// The envelope of the carrier of one node, scaled so a keyed carrier of amplitude 1 comes out as 1
+template<class Config>
+class BandDemodulator {
+public:
+    explicit BandDemodulator(bool senderIsNode1 = true) { tune(senderIsNode1); }
+
+    // Listens to the other band from now on, forgetting what came before
+    void tune(bool senderIsNode1) {
+        band = senderIsNode1 ? 0 : 1;
+        for (auto &filter: bands) filter.reset();
+    }
+
+    [[nodiscard]] bool tunedTo() const { return band == 0; }
+
+    float processSample(float x) {
+        auto &filter = bands[band];
+        return (float) (M_PI / 2) * filter.envelope.processSample(std::fabs(filter.second.processSample(
+                filter.first.processSample(x))));
+    }
+
+private:
+    struct Filter {
+        explicit Filter(bool isNode1) :
+                first(coefficients(isNode1)), second(coefficients(isNode1)), envelope(bandPeriod<Config>(isNode1)) {}
+
+        static dsp::Biquad::Coefficients coefficients(bool isNode1) {
+            return dsp::Biquad::bandPass(1.0, 1.0 / bandPeriod<Config>(isNode1), Config::BAND_Q);
+        }
+
+        void reset() {
+            first.reset();
+            second.reset();
+            envelope.reset();
+        }
+
+        dsp::Biquad first, second; // in cascade, for a steeper skirt towards the other band
+        dsp::MovingAverage envelope;
+    };
+
+    Filter bands[2]{Filter(true), Filter(false)};
+    int band{0};
+};
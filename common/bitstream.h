@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "BitStream hands its words to CRCs as bytes, which needs a little-endian host"
+#endif
+
+/* Packed sequence of bits for Part1 and Part2
+ *
+ * Bit i lives in bit i % 64 of word i / 64, so bytes appended LSB first are stored as they are and
+ * a CRC runs straight over the words. Bits past size() are always zero.
+ */
+class BitStream {
+public:
+    BitStream() = default;
+
+    // bits zeros
+    explicit BitStream(size_t bits) : words((bits + 63) / 64), count(bits) {}
+
+    [[nodiscard]] size_t size() const { return count; }
+
+    [[nodiscard]] bool empty() const { return count == 0; }
+
+    void clear() {
+        words.clear();
+        count = 0;
+    }
+
+    void reserve(size_t bits) { words.reserve((bits + 63) / 64); }
+
+    [[nodiscard]] bool operator[](size_t i) const { return words[i >> 6] >> (i & 63) & 1; }
+
+    void set(size_t i, bool bit) {
+        auto mask = uint64_t(1) << (i & 63);
+        words[i >> 6] = bit ? words[i >> 6] | mask : words[i >> 6] & ~mask;
+    }
+
+    void push(bool bit) { write(bit, 1); }
+
+    // Appends the low n bits of value, LSB first; n <= 64
+    void write(uint64_t value, unsigned n) {
+        if (n == 0) return;
+        if (n < 64) value &= (uint64_t(1) << n) - 1;
+        auto offset = count & 63;
+        if (offset == 0) {
+            words.push_back(value);
+        } else {
+            words.back() |= value << offset;
+            if (offset + n > 64) words.push_back(value >> (64 - offset));
+        }
+        count += n;
+    }
+
+    // n <= 64 bits starting at pos, LSB first; they must lie within size()
+    [[nodiscard]] uint64_t read(size_t pos, unsigned n) const {
+        if (n == 0) return 0;
+        auto word = pos >> 6;
+        auto offset = pos & 63;
+        auto ret = words[word] >> offset;
+        if (offset + n > 64) ret |= words[word + 1] << (64 - offset);
+        return n < 64 ? ret & ((uint64_t(1) << n) - 1) : ret;
+    }
+
+    // Appends n bytes, each LSB first
+    void append(const char *bytes, size_t n) {
+        reserve(count + n * 8);
+        for (; n >= 8; bytes += 8, n -= 8) {
+            uint64_t word;
+            memcpy(&word, bytes, 8);
+            write(word, 64);
+        }
+        for (; n > 0; ++bytes, --n) write((unsigned char) *bytes, 8);
+    }
+
+    // Appends n bits of other starting at pos
+    void append(const BitStream &other, size_t pos, size_t n) {
+        reserve(count + n);
+        for (auto end = pos + n; pos < end; pos += 64) {
+            auto bits = (unsigned) std::min<size_t>(64, end - pos);
+            write(other.read(pos, bits), bits);
+        }
+    }
+
+    // The packed bits as bytes, LSB first
+    [[nodiscard]] const unsigned char *data() const { return reinterpret_cast<const unsigned char *>(words.data()); }
+
+    // Feeds the first bits bits to a boost CRC as bytes, LSB first, the last one zero padded
+    template<class Crc>
+    void process(Crc &crc, size_t bits) const {
+        crc.process_bytes(data(), bits / 8);
+        if (bits % 8) crc.process_byte((unsigned char) (data()[bits / 8] & ((1u << (bits % 8)) - 1)));
+    }
+
+    template<class Crc>
+    void process(Crc &crc) const { process(crc, count); }
+
+    // For streams that go MSB first: write(reverse(byte), 8) and reverse(read(pos, 8))
+    static uint8_t reverse(uint8_t byte) {
+        byte = (uint8_t) ((byte & 0xf0) >> 4 | (byte & 0x0f) << 4);
+        byte = (uint8_t) ((byte & 0xcc) >> 2 | (byte & 0x33) << 2);
+        return (uint8_t) ((byte & 0xaa) >> 1 | (byte & 0x55) << 1);
+    }
+
+private:
+    std::vector<uint64_t> words;
+    size_t count{0};
+};
+
+// Reads a BitStream front to back
+class BitCursor {
+public:
+    explicit BitCursor(const BitStream &source, size_t start = 0) : stream(&source), pos(start) {}
+
+    [[nodiscard]] size_t position() const { return pos; }
+
+    [[nodiscard]] size_t left() const { return stream->size() - pos; }
+
+    bool next() { return (*stream)[pos++]; }
+
+    // The next n <= 64 bits, LSB first
+    uint64_t take(unsigned n) {
+        auto ret = stream->read(pos, n);
+        pos += n;
+        return ret;
+    }
+
+private:
+    const BitStream *stream;
+    size_t pos;
+};
@@ -0,0 +1,86 @@
+#include "capture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+bool AudioCapture::start(const std::string &path, double sampleRate) {
+    if (running) return true;
+    out = fopen(path.c_str(), "wb");
+    if (out == nullptr) return false;
+    fwrite("P2CAPT01", 1, 8, out);
+    fwrite(&sampleRate, sizeof(sampleRate), 1, out);
+    running = true;
+    worker = std::thread([this] {
+        while (running) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+    return true;
+}
+
+void AudioCapture::stop() {
+    if (!running) return;
+    running = false;
+    worker.join();
+    drain();
+    fclose(out);
+    out = nullptr;
+}
+
+void AudioCapture::push(const float *data, int numSamples) {
+    if (!running.load(std::memory_order_relaxed)) return;
+    auto sHead = sampleHead.load(std::memory_order_relaxed);
+    auto bHead = blockHead.load(std::memory_order_relaxed);
+    if (sHead + numSamples - sampleTail.load(std::memory_order_acquire) > SAMPLE_RING ||
+        bHead - blockTail.load(std::memory_order_acquire) == BLOCK_RING) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (int i = 0; i < numSamples; ++i) samples[(sHead + i) & (SAMPLE_RING - 1)] = data[i];
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    blocks[bHead & (BLOCK_RING - 1)] = {(uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+                                        (uint32_t) numSamples};
+    sampleHead.store(sHead + numSamples, std::memory_order_release);
+    blockHead.store(bHead + 1, std::memory_order_release);
+}
+
+void AudioCapture::drain() {
+    auto bTail = blockTail.load(std::memory_order_relaxed);
+    auto sTail = sampleTail.load(std::memory_order_relaxed);
+    for (auto bHead = blockHead.load(std::memory_order_acquire); bTail != bHead; ++bTail) {
+        auto block = blocks[bTail & (BLOCK_RING - 1)];
+        fwrite(&block.timestamp, sizeof(block.timestamp), 1, out);
+        fwrite(&block.numSamples, sizeof(block.numSamples), 1, out);
+        // the block may wrap around the end of the ring
+        auto begin = sTail & (SAMPLE_RING - 1);
+        auto first = std::min<uint64_t>(block.numSamples, SAMPLE_RING - begin);
+        fwrite(&samples[begin], sizeof(float), first, out);
+        fwrite(&samples[0], sizeof(float), block.numSamples - first, out);
+        sTail += block.numSamples;
+        sampleTail.store(sTail, std::memory_order_release);
+        blockTail.store(bTail + 1, std::memory_order_release);
+    }
+    fflush(out);
+}
+
+CaptureReader::CaptureReader(const std::string &path) : in(fopen(path.c_str(), "rb")) {
+    char magic[8];
+    if (in != nullptr &&
+        (fread(magic, 1, 8, in) != 8 || memcmp(magic, "P2CAPT01", 8) != 0 || fread(&rate, sizeof(rate), 1, in) != 1)) {
+        fclose(in);
+        in = nullptr;
+    }
+}
+
+CaptureReader::~CaptureReader() {
+    if (in != nullptr) fclose(in);
+}
+
+bool CaptureReader::next(CaptureBlock &block, std::vector<float> &data) {
+    if (in == nullptr || fread(&block.timestamp, sizeof(block.timestamp), 1, in) != 1 ||
+        fread(&block.numSamples, sizeof(block.numSamples), 1, in) != 1)
+        return false;
+    data.resize(block.numSamples);
+    return fread(data.data(), sizeof(float), block.numSamples, in) == block.numSamples;
+}
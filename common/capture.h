@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Raw audio capture
+ *
+ * The audio callback hands every input block to push(), which only copies it into preallocated
+ * lock-free rings; a background thread writes the rings to disk.
+ *
+ * File layout: "P2CAPT01", double sampleRate, then per block
+ *   uint64_t timestamp (steady_clock nanoseconds), uint32_t numSamples, float samples[numSamples]
+ */
+
+struct CaptureBlock {
+    uint64_t timestamp;
+    uint32_t numSamples;
+};
+
+class AudioCapture {
+public:
+    AudioCapture() = default;
+
+    AudioCapture(const AudioCapture &) = delete;
+
+    ~AudioCapture() { stop(); }
+
+    // Returns false if the file cannot be opened
+    bool start(const std::string &path, double sampleRate);
+
+    void stop();
+
+    [[nodiscard]] bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+    // Audio thread only: wait-free, drops the block if the writer has fallen behind
+    void push(const float *data, int numSamples);
+
+    [[nodiscard]] uint64_t droppedBlocks() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t SAMPLE_RING = 1 << 21; // ~43s at 48kHz
+    static constexpr size_t BLOCK_RING = 1 << 14;
+
+    void drain();
+
+    std::unique_ptr<float[]> samples{new float[SAMPLE_RING]};
+    std::unique_ptr<CaptureBlock[]> blocks{new CaptureBlock[BLOCK_RING]};
+    std::atomic<uint64_t> sampleHead{0}, sampleTail{0}, blockHead{0}, blockTail{0};
+    std::atomic<uint64_t> dropped{0};
+
+    FILE *out{nullptr};
+    std::thread worker;
+    std::atomic<bool> running{false};
+};
+
+// Reads a capture file back, block by block
+class CaptureReader {
+public:
+    explicit CaptureReader(const std::string &path);
+
+    ~CaptureReader();
+
+    [[nodiscard]] bool isOpen() const { return in != nullptr; }
+
+    [[nodiscard]] double sampleRate() const { return rate; }
+
+    // Returns false at the end of the file
+    bool next(CaptureBlock &block, std::vector<float> &data);
+
+private:
+    FILE *in{nullptr};
+    double rate{0};
+};
@@ -0,0 +1,55 @@
+#include "channel.h"
+#include <algorithm>
+#include <cmath>
+
+Channel::Channel(ChannelConfig channelConfig)
+        : cfg(std::move(channelConfig)), rng(cfg.seed), gaussian(0.0f, 1.0f),
+          noiseSigma((float) std::pow(10.0, -cfg.snrDb / 20.0)), pendingDelay(cfg.delaySamples),
+          ratio(1.0 + cfg.driftPpm * 1e-6) {
+    if (cfg.taps.empty()) cfg.taps.push_back(1.0f);
+    history.assign(cfg.taps.size(), 0.0f);
+}
+
+float Channel::receiverNoise() {
+    float ret = cfg.dcOffset + noiseSigma * gaussian(rng);
+    if (cfg.jammingAmplitude > 0) {
+        if (jammingLeft-- <= 0) {
+            jamming = !jamming;
+            double lo = jamming ? cfg.jammingNoisyMin : cfg.jammingQuietMin;
+            double hi = jamming ? cfg.jammingNoisyMax : cfg.jammingQuietMax;
+            double seconds = lo + (hi - lo) * (uniform(rng) + 1.0) / 2.0;
+            jammingLeft = (long long) (seconds * cfg.sampleRate);
+        }
+        if (jamming) ret += cfg.jammingAmplitude * uniform(rng);
+    }
+    return ret;
+}
+
+void Channel::process(const float *in, size_t n, std::vector<float> &out) {
+    auto numTaps = cfg.taps.size();
+    for (size_t i = 0; i < n; ++i) {
+        // multipath, history is a ring holding the most recent numTaps inputs
+        history[historyPos] = cfg.gain * in[i];
+        float sample = 0;
+        for (size_t k = 0; k < numTaps; ++k) sample += cfg.taps[k] * history[(historyPos + numTaps - k) % numTaps];
+        historyPos = (historyPos + 1) % numTaps;
+        // propagation delay: the receiver hears silence first
+        for (; pendingDelay > 0; --pendingDelay) out.push_back(receiverNoise());
+        // receiver clock drift, linear interpolation between the two latest tx samples
+        prev = cur;
+        cur = sample;
+        if (!primed) {
+            primed = true;
+            continue;
+        }
+        for (; phase < 1.0; phase += ratio) {
+            out.push_back(prev + (float) phase * (cur - prev) + receiverNoise());
+        }
+        phase -= 1.0;
+    }
+}
+
+void Channel::idle(size_t n, std::vector<float> &out) {
+    static const float zeros[256]{};
+    for (; n > 0; n -= std::min<size_t>(n, 256)) process(zeros, std::min<size_t>(n, 256), out);
+}
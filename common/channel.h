@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/* Acoustic channel model between two simulated nodes
+ *
+ * tx samples -> gain -> multipath FIR -> propagation delay -> receiver clock drift
+ *            -> + AWGN -> + bursty jamming -> + DC offset -> rx samples
+ *
+ * Everything is driven by one seeded generator, so a run is reproducible sample by sample.
+ */
+
+struct ChannelConfig {
+    double sampleRate = 48000;
+    float gain = 1.0f;
+    std::vector<float> taps{1.0f};  // impulse response, taps[0] is the direct path
+    unsigned delaySamples = 0;      // propagation delay
+    double driftPpm = 0;            // receiver sample clock offset against the transmitter
+    double snrDb = 100;             // AWGN, relative to a full-scale (power 1) transmission
+    // On/off noise bursts, same pattern as JammingWav.m
+    float jammingAmplitude = 0;     // 0 disables jamming
+    double jammingQuietMin = 0.1, jammingQuietMax = 0.2;
+    double jammingNoisyMin = 0.05, jammingNoisyMax = 0.1;
+    float dcOffset = 0;             // receiver bias, e.g. of a microphone input
+    uint32_t seed = 1;
+};
+
+class Channel {
+public:
+    explicit Channel(ChannelConfig channelConfig);
+
+    // Push n transmitted samples through the channel, appending the received ones to out
+    void process(const float *in, size_t n, std::vector<float> &out);
+
+    // Feed silence, e.g. to flush the delay line or to model idle time between frames
+    void idle(size_t n, std::vector<float> &out);
+
+    [[nodiscard]] const ChannelConfig &config() const { return cfg; }
+
+private:
+    float receiverNoise();
+
+    ChannelConfig cfg;
+    std::mt19937 rng;
+    std::normal_distribution<float> gaussian;
+    std::uniform_real_distribution<float> uniform{-1.0f, 1.0f};
+    float noiseSigma;
+
+    std::vector<float> history;     // ring of the last taps.size() inputs times gain, newest just before historyPos
+    size_t historyPos = 0;
+    unsigned pendingDelay;
+
+    double ratio;                   // tx samples per rx sample
+    double phase = 0;               // position of the next rx sample between prev and cur
+    float prev = 0, cur = 0;
+    bool primed = false;
+
+    bool jamming = false;
+    long long jammingLeft = 0;
+};
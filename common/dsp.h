@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+/* Streaming filters for block-based audio
+ *
+ * Every filter keeps its state between calls, so an audio stream can be fed block by block (or
+ * sample by sample) and comes out the same as if it had been filtered in one piece. process()
+ * works in place; nothing allocates after construction. The cost per sample never depends on a
+ * window length except for Fir and Resampler, whose dot products run on contiguous memory in
+ * SIMD-sized lanes.
+ */
+
+namespace dsp {
+
+// Sum of a[i] * b[i] in eight independent lanes, which compilers turn into vector instructions
+// without needing -ffast-math
+inline float dot(const float *a, const float *b, size_t n) {
+    constexpr size_t LANES = 8;
+    float lane[LANES]{};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+        for (size_t j = 0; j < LANES; ++j) lane[j] += a[i + j] * b[i + j];
+    float sum = 0;
+    for (; i < n; ++i) sum += a[i] * b[i];
+    for (auto value: lane) sum += value;
+    return sum;
+}
+
+// Causal mean of the last span samples, one add and one subtract per sample
+class MovingAverage {
+public:
+    explicit MovingAverage(size_t span) : window(std::max<size_t>(span, 1), 0.0f) {}
+
+    float processSample(float x) {
+        sum += x - window[pos];
+        window[pos] = x;
+        pos = pos + 1 == window.size() ? 0 : pos + 1;
+        return (float) (sum / (double) window.size());
+    }
+
+    void process(float *data, size_t n) {
+        for (size_t i = 0; i < n; ++i) data[i] = processSample(data[i]);
+    }
+
+    void reset() {
+        std::fill(window.begin(), window.end(), 0.0f);
+        sum = 0;
+    }
+
+private:
+    std::vector<float> window;
+    size_t pos{0};
+    double sum{0}; // double, so adding and subtracting the same samples does not drift
+};
+
+/* y[n] = sum of taps[k] * x[n - k]
+ *
+ * The delay line is stored twice in a row, so the last taps.size() inputs are always one
+ * contiguous run (recent()) and the dot product never wraps.
+ */
+class Fir {
+public:
+    explicit Fir(std::vector<float> coefficients) :
+            reversed(coefficients.rbegin(), coefficients.rend()), line(2 * reversed.size(), 0.0f) {}
+
+    float processSample(float x) {
+        auto size = reversed.size();
+        line[pos] = x;
+        line[pos + size] = x;
+        pos = pos + 1 == size ? 0 : pos + 1;
+        return dot(reversed.data(), recent(), size);
+    }
+
+    void process(float *data, size_t n) {
+        for (size_t i = 0; i < n; ++i) data[i] = processSample(data[i]);
+    }
+
+    // The last taps() inputs, oldest first
+    [[nodiscard]] const float *recent() const { return line.data() + pos; }
+
+    [[nodiscard]] size_t taps() const { return reversed.size(); }
+
+    void reset() {
+        std::fill(line.begin(), line.end(), 0.0f);
+        pos = 0;
+    }
+
+private:
+    std::vector<float> reversed; // taps, last one first, to line up with recent()
+    std::vector<float> line;
+    size_t pos{0};
+};
+
+/* Rational sample rate converter, polyphase
+ *
+ * Converts fromRate to toRate as up / down (both reduced by their gcd): conceptually the input is
+ * stuffed with up - 1 zeros, low-passed below the lower Nyquist frequency of the two and kept
+ * every down-th sample. Only the branch of the windowed-sinc prototype that lines up with an
+ * output is ever computed, one dot product of tapsPerPhase() over the last inputs, which sit
+ * contiguously in a delay line stored twice like Fir's. The delay is about half of those inputs.
+ */
+class Resampler {
+public:
+    Resampler(unsigned fromRate, unsigned toRate) :
+            up(toRate / std::gcd(fromRate, toRate)), down(fromRate / std::gcd(fromRate, toRate)),
+            taps(BASE_TAPS * std::max(1u, (down + up - 1) / up)), branches(up * taps), line(2 * taps, 0.0f) {
+        // Blackman-windowed sinc at up times the input rate, cut off at 90% of the lower Nyquist
+        auto length = up * taps;
+        auto cutoff = PASSBAND / std::max(up, down);
+        for (unsigned i = 0; i < length; ++i) {
+            auto t = i - (length - 1) / 2.0;
+            auto sinc = t == 0 ? 2 * cutoff : std::sin(2 * M_PI * cutoff * t) / (M_PI * t);
+            auto x = 2 * M_PI * i / (length - 1);
+            auto window = 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2 * x);
+            // branch p holds taps p, p + up, ..., last one first to line up with the delay line
+            branches[(i % up) * taps + taps - 1 - i / up] = (float) (sinc * window * up);
+        }
+    }
+
+    // The highest frequency converting between the two rates passes, in Hz
+    static double passband(double fromRate, double toRate) { return PASSBAND * std::min(fromRate, toRate); }
+
+    // Feeds one input; writes the outputs it completes to out (at most maxOutputs()) and returns how many
+    size_t push(float x, float *out) {
+        line[pos] = x;
+        line[pos + taps] = x;
+        pos = pos + 1 == taps ? 0 : pos + 1;
+        size_t count = 0;
+        for (; phase < up; phase += down) out[count++] = dot(branches.data() + phase * taps, line.data() + pos, taps);
+        phase -= up;
+        return count;
+    }
+
+    // Feeds n inputs; returns the outputs written to out, at most outputsFor(n)
+    size_t process(const float *in, size_t n, float *out) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) count += push(in[i], out + count);
+        return count;
+    }
+
+    // Inputs to push before n more outputs are out; the last of them may complete a few more
+    [[nodiscard]] size_t inputsFor(size_t n) const { return n == 0 ? 0 : (phase + (n - 1) * down) / up + 1; }
+
+    // The most outputs n inputs can complete
+    [[nodiscard]] size_t outputsFor(size_t n) const { return (n * up + down - 1) / down + 1; }
+
+    [[nodiscard]] size_t maxOutputs() const { return (up + down - 1) / down; }
+
+    [[nodiscard]] size_t tapsPerPhase() const { return taps; }
+
+    void reset() {
+        std::fill(line.begin(), line.end(), 0.0f);
+        pos = 0;
+        phase = 0;
+    }
+
+private:
+    static constexpr unsigned BASE_TAPS = 16; // per branch, times down / up when decimating
+    static constexpr double PASSBAND = 0.45;  // times the lower rate
+
+    unsigned up, down, taps;
+    std::vector<float> branches; // up branches of taps each
+    std::vector<float> line;
+    size_t pos{0};
+    unsigned phase{0}; // up times how far the next output lies past the next input
+};
+
+// Second-order IIR section, transposed direct form II
+class Biquad {
+public:
+    struct Coefficients {
+        float b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0; // a0 normalised to 1
+    };
+
+    // RBJ audio EQ cookbook designs; frequencies in Hz
+    static Coefficients lowPass(double sampleRate, double frequency, double q = M_SQRT1_2) {
+        auto [w, alpha] = prewarp(sampleRate, frequency, q);
+        auto cosw = std::cos(w);
+        return normalise((1 - cosw) / 2, 1 - cosw, (1 - cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+    }
+
+    static Coefficients highPass(double sampleRate, double frequency, double q = M_SQRT1_2) {
+        auto [w, alpha] = prewarp(sampleRate, frequency, q);
+        auto cosw = std::cos(w);
+        return normalise((1 + cosw) / 2, -(1 + cosw), (1 + cosw) / 2, 1 + alpha, -2 * cosw, 1 - alpha);
+    }
+
+    // 0 dB peak gain at frequency
+    static Coefficients bandPass(double sampleRate, double frequency, double q) {
+        auto [w, alpha] = prewarp(sampleRate, frequency, q);
+        return normalise(alpha, 0, -alpha, 1 + alpha, -2 * std::cos(w), 1 - alpha);
+    }
+
+    Biquad() = default;
+
+    explicit Biquad(const Coefficients &coefficients) : c(coefficients) {}
+
+    float processSample(float x) {
+        auto y = c.b0 * x + z1;
+        z1 = c.b1 * x - c.a1 * y + z2;
+        z2 = c.b2 * x - c.a2 * y;
+        return y;
+    }
+
+    void process(float *data, size_t n) {
+        for (size_t i = 0; i < n; ++i) data[i] = processSample(data[i]);
+    }
+
+    void reset() { z1 = z2 = 0; }
+
+private:
+    struct Prewarped {
+        double w, alpha;
+    };
+
+    static Prewarped prewarp(double sampleRate, double frequency, double q) {
+        auto w = 2 * M_PI * frequency / sampleRate;
+        return {w, std::sin(w) / (2 * q)};
+    }
+
+    static Coefficients normalise(double b0, double b1, double b2, double a0, double a1, double a2) {
+        return {(float) (b0 / a0), (float) (b1 / a0), (float) (b2 / a0), (float) (a1 / a0), (float) (a2 / a0)};
+    }
+
+    Coefficients c;
+    float z1{0}, z2{0};
+};
+
+// y[n] = x[n] - x[n - 1] + pole * y[n - 1]: removes DC, passes everything well above
+// (1 - pole) * sampleRate / 2pi
+class DcBlocker {
+public:
+    explicit DcBlocker(float polePosition = 0.995f) : pole(polePosition) {}
+
+    float processSample(float x) {
+        auto y = x - x1 + pole * y1;
+        x1 = x;
+        y1 = y;
+        return y;
+    }
+
+    void process(float *data, size_t n) {
+        for (size_t i = 0; i < n; ++i) data[i] = processSample(data[i]);
+    }
+
+    void reset() { x1 = y1 = 0; }
+
+private:
+    float pole;
+    float x1{0}, y1{0};
+};
+
+// Running trapezoidal integral with a fixed step; the first sample integrates to 0
+class Integrator {
+public:
+    explicit Integrator(double step) : dt(step) {}
+
+    float processSample(float x) {
+        if (started) total += dt * (last + x) / 2;
+        started = true;
+        last = x;
+        return (float) total;
+    }
+
+    void process(float *data, size_t n) {
+        for (size_t i = 0; i < n; ++i) data[i] = processSample(data[i]);
+    }
+
+    void reset() {
+        total = 0;
+        started = false;
+    }
+
+private:
+    double dt;
+    double total{0};
+    float last{0};
+    bool started{false};
+};
+
+// Follows the quietest level seen: falls to a lower one at once and rises by riseRate of the gap
+// per update, so a burst of signal barely moves it while a louder background is learned in time
+class FloorTracker {
+public:
+    explicit FloorTracker(float riseRate) : rate(riseRate) {}
+
+    float update(float level) {
+        floor = !started || level < floor ? level : floor + rate * (level - floor);
+        started = true;
+        return floor;
+    }
+
+    [[nodiscard]] float value() const { return floor; }
+
+    void reset() {
+        floor = 0;
+        started = false;
+    }
+
+private:
+    float rate;
+    float floor{0};
+    bool started{false};
+};
+
+}// namespace dsp
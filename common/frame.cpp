@@ -0,0 +1,14 @@
+#include "frame.h"
+#include <boost/crc.hpp>
+
+unsigned int crc32(const char *src, size_t srcSize) {
+    boost::crc_32_type crc;
+    crc.process_bytes(src, srcSize);
+    return crc.checksum();
+}
+
+unsigned char crc8(const char *src, size_t srcSize) {
+    boost::crc_optimal<8, 0x07> crc;
+    crc.process_bytes(src, srcSize);
+    return crc.checksum();
+}
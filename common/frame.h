@@ -0,0 +1,108 @@
+#pragma once
+
+#include "link_config.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+
+unsigned int crc32(const char *src, size_t srcSize);
+
+unsigned char crc8(const char *src, size_t srcSize);
+
+template<class T>
+[[nodiscard]] std::string inString(T object) {
+    return {(const char *) &object, sizeof(T)};
+}
+
+template<class Config>
+class FrameType {
+public:
+    using LENType = typename Config::LENType;
+    using SEQType = typename Config::SEQType;
+
+    LENType len = 0;
+    SEQType seq = 0;
+    unsigned char bitLength = Config::LENGTH_OF_ONE_BIT; // RATE
+    unsigned char stream = 0;                            // STREAM, NACK_STREAM on a NACK
+    char body[Config::MAX_LENGTH_BODY]{};
+    // Not on air: the input sample right after the preamble. The audio callback feeds input and
+    // output together, so unless the input overran this is also a sample of the output clock.
+    uint64_t receivedAt = 0;
+    // Not on air: the SNR its preamble was heard with, in dB
+    float snrDb = 0;
+    // Not on air: HCRC matched but CRC did not, so only LEN up to STREAM can be trusted
+    bool damaged = false;
+    // Not on air: the lane (audio channel) it arrived on
+    unsigned char lane = 0;
+    // Not on air: LatencyStats::now() when its preamble was found, its CRC checked and the MAC took it
+    uint64_t detectedMicros = 0, decodedMicros = 0, deliveredMicros = 0;
+
+    FrameType() = default;
+
+    FrameType(LENType numLen, SEQType numSeq, const char *bodySrc) :
+            len(numLen), seq(numSeq) {
+        memcpy(body, bodySrc, len);
+    }
+
+    // LEN up to STREAM
+    [[nodiscard]] std::string headerString() const {
+        return inString(len) + inString(seq) + inString(rateStream());
+    }
+
+    // RATE and STREAM as they go on air, one nibble each
+    [[nodiscard]] unsigned char rateStream() const {
+        auto onAir = stream == Config::NACK_STREAM ? NACK_NIBBLE : stream;
+        return (unsigned char) (bitLength / 2 | onAir << 4);
+    }
+
+    void setRateStream(unsigned char onAir) {
+        bitLength = (unsigned char) ((onAir & 0xf) * 2);
+        stream = onAir >> 4 == NACK_NIBBLE ? Config::NACK_STREAM : (unsigned char) (onAir >> 4);
+    }
+
+    [[nodiscard]] unsigned char headerCrc() const {
+        auto str = headerString();
+        return crc8(str.c_str(), str.size());
+    }
+
+    // LEN up to BODY, what CRC covers
+    [[nodiscard]] std::string wholeString() const {
+        std::string ret = headerString() + inString(headerCrc()) + std::string(body, len);
+        return ret;
+    }
+
+    [[nodiscard]] bool isNack() const { return len == 0 && stream == Config::NACK_STREAM; }
+
+    [[nodiscard]] unsigned int crc() const {
+        auto str = wholeString();
+        return crc32(str.c_str(), str.size());
+    }
+
+private:
+    static constexpr unsigned char NACK_NIBBLE = 0xf;
+};
+
+using std::chrono::steady_clock;
+
+class MyTimer {
+public:
+    std::chrono::time_point<steady_clock> start;
+
+    MyTimer() : start(steady_clock::now()) {}
+
+    void restart() { start = steady_clock::now(); }
+
+    [[nodiscard]] double duration() const {
+        auto now = steady_clock::now();
+        return std::chrono::duration<double>(now - start).count();
+    }
+};
+
+struct FrameWaitingInfo {
+    bool receiveACK = false;
+    MyTimer timer;
+    int resendTimes = 20;
+    uint64_t transmission = 0; // id of the last transmission of the frame
+    bool aired = false;        // that transmission has left the air
+    int laterAcks = 0;         // later frames acknowledged since, see FAST_RETRANSMIT_ACKS
+};
@@ -0,0 +1,163 @@
+#include "gateway.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t LENGTH_SIZE = 2; // ahead of every datagram on the link, little-endian
+constexpr size_t SLOT = LENGTH_SIZE + UdpGateway::MAX_DATAGRAM;
+constexpr int RECEIVE_BUFFER = 1 << 20;
+
+sockaddr_in localhost(uint16_t portNetworkOrder) {
+    sockaddr_in ret{};
+    ret.sin_family = AF_INET;
+    ret.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ret.sin_port = portNetworkOrder;
+    return ret;
+}
+
+// One batch of datagrams to or from the socket, each in its own buffer
+struct Batch {
+    iovec vectors[UdpGateway::BATCH]{};
+    sockaddr_in addresses[UdpGateway::BATCH]{};
+#ifdef __linux__
+    mmsghdr messages[UdpGateway::BATCH]{};
+#endif
+    unsigned size = 0;
+
+    // Waits for at least one datagram, then takes what else is there; returns how many arrived
+    int receive(int fd) {
+#ifdef __linux__
+        for (unsigned i = 0; i < UdpGateway::BATCH; ++i) {
+            messages[i].msg_hdr = {};
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+        }
+        int n = recvmmsg(fd, messages, UdpGateway::BATCH, MSG_WAITFORONE, nullptr);
+        for (int i = 0; i < n; ++i) vectors[i].iov_len = messages[i].msg_len;
+        return n;
+#else
+        socklen_t length = sizeof(addresses[0]);
+        auto n = recvfrom(fd, vectors[0].iov_base, vectors[0].iov_len, 0, (sockaddr *) &addresses[0], &length);
+        if (n < 0) return -1;
+        vectors[0].iov_len = (size_t) n;
+        return 1;
+#endif
+    }
+
+    // Sends the first size datagrams to destination
+    void send(int fd, const sockaddr_in &destination) {
+#ifdef __linux__
+        for (unsigned i = 0; i < size; ++i) {
+            messages[i].msg_hdr = {};
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = (void *) &destination;
+            messages[i].msg_hdr.msg_namelen = sizeof(destination);
+        }
+        for (unsigned sent = 0; sent < size;) {
+            int n = sendmmsg(fd, messages + sent, size - sent, 0);
+            if (n <= 0) break;
+            sent += (unsigned) n;
+        }
+#else
+        for (unsigned i = 0; i < size; ++i)
+            sendto(fd, vectors[i].iov_base, vectors[i].iov_len, 0, (const sockaddr *) &destination, sizeof(destination));
+#endif
+        size = 0;
+    }
+};
+
+}// namespace
+
+UdpGateway::UdpGateway(std::unique_ptr<LinkSocket> linkSocket, uint16_t listenPort, uint16_t forwardPort) :
+        socket(std::move(linkSocket)), listen(listenPort), forward(forwardPort) {}
+
+bool UdpGateway::start() {
+    if (running) return true;
+    fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return false;
+    auto address = localhost(htons(listen));
+    // recvmmsg wakes up this often to notice stop()
+    timeval timeout{0, 50000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // a burst of small datagrams fills the default buffer long before it fills the link
+    int bufferSize = RECEIVE_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    socklen_t length = sizeof(address);
+    if (bind(fd, (const sockaddr *) &address, sizeof(address)) != 0 ||
+        getsockname(fd, (sockaddr *) &address, &length) != 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    bound = ntohs(address.sin_port);
+    running = true;
+    up = std::thread([this] { uplink(); });
+    down = std::thread([this] { downlink(); });
+    return true;
+}
+
+void UdpGateway::stop() {
+    if (!running.exchange(false)) return;
+    // wakes a write() or read() blocked on the link
+    socket->close();
+    up.join();
+    down.join();
+    ::close(fd);
+    fd = -1;
+}
+
+void UdpGateway::uplink() {
+    // every datagram lands right behind the room for its size
+    std::vector<char> buffer(BATCH * SLOT);
+    Batch batch;
+    while (running) {
+        for (unsigned i = 0; i < BATCH; ++i) batch.vectors[i] = {buffer.data() + i * SLOT + LENGTH_SIZE, MAX_DATAGRAM};
+        int n = batch.receive(fd);
+        for (int i = 0; i < n; ++i) {
+            auto size = (uint16_t) batch.vectors[i].iov_len;
+            auto slot = buffer.data() + i * SLOT;
+            slot[0] = (char) (size & 0xff);
+            slot[1] = (char) (size >> 8);
+            lastSender = batch.addresses[i].sin_port;
+            if (socket->write(slot, LENGTH_SIZE + size) < LENGTH_SIZE + size) return;
+            ++datagramsIn;
+            bytesIn += size;
+        }
+    }
+}
+
+void UdpGateway::downlink() {
+    // room for a whole datagram behind whatever part of the next one is left over
+    std::vector<char> buffer(2 * SLOT);
+    size_t filled = 0;
+    Batch batch;
+    while (running) {
+        auto n = socket->read(buffer.data() + filled, buffer.size() - filled);
+        if (n == 0) return;
+        filled += n;
+        auto destination = localhost(forward ? htons(forward) : (uint16_t) lastSender.load());
+        size_t pos = 0;
+        for (size_t size; filled - pos >= LENGTH_SIZE; pos += LENGTH_SIZE + size) {
+            auto length = (const unsigned char *) buffer.data() + pos;
+            size = length[0] | (size_t) length[1] << 8;
+            if (filled - pos < LENGTH_SIZE + size) break;
+            // nobody to send it to before the first local sender
+            if (destination.sin_port == 0) continue;
+            batch.vectors[batch.size++] = {buffer.data() + pos + LENGTH_SIZE, size};
+            ++datagramsOut;
+            bytesOut += size;
+            if (batch.size == BATCH) batch.send(fd, destination);
+        }
+        batch.send(fd, destination);
+        memmove(buffer.data(), buffer.data() + pos, filled - pos);
+        filled -= pos;
+    }
+}
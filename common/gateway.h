@@ -0,0 +1,57 @@
+#pragma once
+
+#include "socket.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* Bridges localhost UDP datagrams over a LinkSocket (POSIX only)
+ *
+ * The gateway binds 127.0.0.1:listenPort. Every datagram a local program sends there goes over the
+ * link as its size in two bytes, little-endian, and the datagram itself; the stream cuts it into
+ * frames of at most MAX_LENGTH_BODY and the other side reassembles it from them. The peer's gateway sends it on
+ * from its own port to 127.0.0.1:forwardPort, or with forwardPort 0 to whoever sent to that
+ * gateway last, so replies find their way back.
+ *
+ * Socket I/O is batched with recvmmsg/sendmmsg (one datagram per call elsewhere). Incoming
+ * datagrams land right behind their size in one buffer, which goes to the link in a single write;
+ * outgoing ones are sent straight out of the buffer they were read from the link into.
+ */
+class UdpGateway {
+public:
+    static constexpr size_t MAX_DATAGRAM = 65507; // what fits in an IPv4 UDP packet
+    static constexpr unsigned BATCH = 32;          // datagrams per recvmmsg/sendmmsg
+
+    UdpGateway(std::unique_ptr<LinkSocket> linkSocket, uint16_t listenPort, uint16_t forwardPort);
+
+    UdpGateway(const UdpGateway &) = delete;
+
+    ~UdpGateway() { stop(); }
+
+    // Binds the port and starts bridging; false if the port cannot be bound
+    bool start();
+
+    // Closes the link socket as well
+    void stop();
+
+    // The port bound, which start() picks if listenPort was 0
+    [[nodiscard]] uint16_t port() const { return bound; }
+
+    std::atomic<uint64_t> datagramsIn{0}, datagramsOut{0}, bytesIn{0}, bytesOut{0};
+
+private:
+    // UDP to link
+    void uplink();
+
+    // Link to UDP
+    void downlink();
+
+    std::unique_ptr<LinkSocket> socket;
+    uint16_t listen, forward, bound{0};
+    int fd{-1};
+    std::atomic<bool> running{false};
+    std::atomic<uint32_t> lastSender{0}; // port of the last local sender, network order; 0 until one sent
+    std::thread up, down;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "frame.h"
+#include "pool.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+// What a node can do, exchanged in the handshake
+struct Capabilities {
+    uint8_t version = 1;
+    uint8_t maxBody = 0; // BODY bytes of the longest frame it sends and receives
+    uint8_t window = 0;  // frames it keeps unacknowledged
+    uint8_t fec = 0;     // a bit per FEC scheme, none exists yet
+    uint8_t streams = 0; // LinkSocket streams
+    uint8_t lanes = 1;   // audio channels frames are striped over
+    uint32_t rates = 0;  // bit b: BODY and CRC at b samples per bit
+
+    static constexpr size_t SIZE = 10; // on air: the six bytes in the order above, then rates little-endian
+
+    template<class Config>
+    static Capabilities of(unsigned lanes = 1) {
+        Capabilities ret;
+        ret.lanes = (uint8_t) lanes;
+        ret.maxBody = (uint8_t) Config::MAX_LENGTH_BODY;
+        ret.window = (uint8_t) Config::SLIDING_WINDOW_SIZE;
+        ret.streams = (uint8_t) Config::STREAMS;
+        for (unsigned b = 0; b <= Config::LENGTH_OF_ONE_BIT; ++b)
+            if (Config::isPayloadBitLength(b)) ret.rates |= 1u << b;
+        return ret;
+    }
+
+    // Whether a link with peer can run at all: the same version, frames long enough for the count
+    // frame 1 carries, at least one frame in the window, one lane and one stream, and a rate both have
+    [[nodiscard]] bool compatible(const Capabilities &peer, unsigned minBody) const {
+        return peer.version == version && peer.maxBody >= minBody && peer.window != 0 && peer.lanes != 0 &&
+               peer.streams != 0 && (rates & peer.rates) != 0;
+    }
+
+    // The fastest settings both ends support, see compatible()
+    [[nodiscard]] Capabilities agree(const Capabilities &peer) const {
+        Capabilities ret;
+        ret.version = std::min(version, peer.version);
+        ret.maxBody = std::min(maxBody, peer.maxBody);
+        ret.window = std::min(window, peer.window);
+        ret.fec = fec & peer.fec;
+        ret.streams = std::min(streams, peer.streams);
+        ret.lanes = std::min(lanes, peer.lanes);
+        ret.rates = rates & peer.rates;
+        return ret;
+    }
+
+    void write(char *out) const {
+        auto bytes = (unsigned char *) out;
+        bytes[0] = version;
+        bytes[1] = maxBody;
+        bytes[2] = window;
+        bytes[3] = fec;
+        bytes[4] = streams;
+        bytes[5] = lanes;
+        for (unsigned i = 0; i < 4; ++i) bytes[6 + i] = (unsigned char) (rates >> 8 * i);
+    }
+
+    void read(const char *in) {
+        auto bytes = (const unsigned char *) in;
+        version = bytes[0];
+        maxBody = bytes[1];
+        window = bytes[2];
+        fec = bytes[3];
+        streams = bytes[4];
+        lanes = bytes[5];
+        rates = 0;
+        for (unsigned i = 0; i < 4; ++i) rates |= (uint32_t) bytes[6 + i] << 8 * i;
+    }
+};
+
+/* Link setup: SYN and SYN-ACK, and the settings both ends agree on
+ *
+ * Node1 sends a SYN with its Capabilities and repeats it every SLIDING_WINDOW_TIMEOUT_NODE1 until
+ * Node2 answers with a SYN-ACK carrying its own, one round trip unless one of them got lost. Both
+ * ends then run with the agreement: the shorter BODY, the smaller window, the rates, FEC schemes
+ * and the number of streams and lanes both support. Both frames go on lane 0, the one lane every
+ * node has. Every MAC hands the frames it cannot place to handle(),
+ * which answers a SYN at any time, so Node1 can renegotiate whenever it likes; a new agreement
+ * takes effect with the next transfer. A SYN or SYN-ACK this node cannot run with (see
+ * Capabilities::compatible) gets no answer and changes nothing, so Node1 runs out of attempts.
+ *
+ * Both are control frames (SEQ 0): SYN or SYN_ACK, the sending node, then the Capabilities. The
+ * preamble and the header go at the base rate, so two nodes only hear each other with the same
+ * LENGTH_OF_ONE_BIT; everything else may differ between their configurations.
+ */
+template<class Config>
+class Handshake {
+public:
+    using Frame = FrameType<Config>;
+    using LENType = typename Config::LENType;
+
+    Handshake(const Handshake &) = delete;
+
+    explicit Handshake(Writer<Config> *writerPtr, LinkStats *statsPtr) :
+            writer(writerPtr), stats(statsPtr), local(Capabilities::of<Config>(writerPtr->laneCount())),
+            agreement(local) {
+        agreement.lanes = 1; // striping needs a peer that listens on the other lanes
+    }
+
+    // Node1 sends up to attempts SYNs until a SYN-ACK comes back; Node2 waits for a SYN as long
+    // as it takes and answers it. Anything else that arrives meanwhile is dropped.
+    bool connect(bool isNode1, FrameQueue<Config> *input, int attempts) {
+        MyTimer sinceSyn;
+        int sent = 0;
+        if (isNode1) sendSyn(isNode1, SYN, sent);
+        while (true) {
+            for (FrameHandle<Config> frame; input->pop(frame);)
+                if (handle(isNode1, *frame) == (isNode1 ? SYN_ACK : SYN)) return true;
+            if (isNode1 && sinceSyn.duration() >= Config::SLIDING_WINDOW_TIMEOUT_NODE1) {
+                if (sent == attempts) {
+                    fprintf(stderr, "Link error detected! no SYN-ACK after %d SYNs...\n", attempts);
+                    return false;
+                }
+                sendSyn(isNode1, SYN, sent);
+                sinceSyn.restart();
+            }
+            Thread::yield();
+        }
+    }
+
+    // Takes a SYN or SYN-ACK of the other node and answers a SYN; returns which one it was, or 0
+    // for any other frame. One whose Capabilities this node cannot run with is dropped unanswered
+    // and the previous agreement stays.
+    char handle(bool isNode1, const Frame &frame) {
+        if (frame.damaged || frame.seq != 0 || frame.len != LENGTH || frame.body[1] == node(isNode1) ||
+            (frame.body[0] != SYN && frame.body[0] != SYN_ACK))
+            return 0;
+        Capabilities peer;
+        peer.read(frame.body + 2);
+        if (!local.compatible(peer, Config::LENGTH_SEQ)) {
+            fprintf(stderr, "Handshake of version %u with %u byte frames, window %u, %u lanes, %u streams "
+                            "and bit lengths 0x%x refused!\n", peer.version, peer.maxBody, peer.window,
+                    peer.lanes, peer.streams, (unsigned) peer.rates);
+            return 0;
+        }
+        auto agreed = local.agree(peer);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            agreement = agreed;
+        }
+        TRACE(trace::Event::Handshake, agreed.maxBody, agreed.window, (int32_t) agreed.rates);
+        LinkStats::add(stats->handshakes);
+        if (frame.body[0] == SYN) {
+            int sent = 0;
+            sendSyn(isNode1, SYN_ACK, sent);
+        }
+        return frame.body[0];
+    }
+
+    // As of the last handshake; this node's own capabilities on one lane before any
+    [[nodiscard]] Capabilities agreed() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return agreement;
+    }
+
+private:
+    static constexpr char SYN = 'S', SYN_ACK = 'A';
+    static constexpr LENType LENGTH = 2 + Capabilities::SIZE; // SYN or SYN_ACK, sending node, Capabilities
+    static_assert(LENGTH <= Config::MAX_LENGTH_BODY, "a SYN fits in one frame");
+
+    static char node(bool isNode1) { return isNode1 ? '1' : '2'; }
+
+    void sendSyn(bool isNode1, char kind, int &sent) {
+        char body[LENGTH]{kind, node(isNode1)};
+        local.write(body + 2);
+        writer->send(Frame(LENGTH, 0, body), OutputScheduler::ASAP, 0);
+        ++sent;
+    }
+
+    Writer<Config> *writer;
+    LinkStats *stats;
+    const Capabilities local;
+    mutable std::mutex lock;
+    Capabilities agreement;
+};
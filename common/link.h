@@ -0,0 +1,211 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "audio_block.h"
+#include "handshake.h"
+#include "link_config.h"
+#include "mac.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "ring.h"
+#include "scheduler.h"
+#include "socket.h"
+#include "stats.h"
+#include "tdma.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The sample rings shared with the audio callback; input, output and quiet point to one per lane
+struct LinkIO {
+    SampleRing *input;
+    OutputScheduler *output;
+    Atomic<bool> *quiet;
+    LinkStats *stats;
+    unsigned lanes = 1; // up to MAX_LANES audio channels, each a PHY of its own
+};
+
+// Which MAC transfer() runs; ping() always uses the CSMA one
+enum class MacMode { Csma, Tdma, TdmaDemand };
+
+constexpr const char *MAC_MODE_NAMES = "csma, tdma, tdma-demand";
+
+// Returns false if there is no MAC called name
+inline bool parseMacMode(const std::string &name, MacMode &mode) {
+    if (name.empty() || name == "csma") {
+        mode = MacMode::Csma;
+    } else if (name == "tdma") {
+        mode = MacMode::Tdma;
+    } else if (name == "tdma-demand") {
+        mode = MacMode::TdmaDemand;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* One PHY + MAC instance, with the configuration hidden behind virtual calls
+ *
+ * Only the entry points are virtual; everything that runs per sample or per frame lives in the
+ * ReceivePipeline/Writer/Mac instantiated for the chosen configuration.
+ */
+class Link {
+public:
+    virtual ~Link() = default;
+
+    // Exchanges capabilities with the other node, see Handshake; Node1 gives up after resendTimes
+    // SYNs without an answer, Node2 waits for one. Call it again any time to renegotiate.
+    virtual bool handshake(bool isNode1, int resendTimes) = 0;
+
+    // What the last handshake settled on, this node's own capabilities before any
+    [[nodiscard]] virtual Capabilities agreed() const = 0;
+
+    // Handshakes first, then sends data to the other node and receives its data
+    virtual TransferResult transfer(bool isNode1, const std::string &data, int resendTimes) = 0;
+
+    // Handshakes as Node1 first, then pings, see Mac::ping
+    virtual TransferResult ping(const std::string &data, double timeout) = 0;
+
+    // Opens stream (0 .. agreed().streams - 1) to the other node, see LinkSocket; nullptr if it is
+    // open already. Streams share one StreamMux, which the first of them starts with isNode1 and
+    // resendTimes and which sends weight frames of this stream for each visit of deficit round robin.
+    // The mux runs with what the last handshake() agreed on and answers SYNs meanwhile. It takes the
+    // frames transfer() and ping() would see, so do not run those while a stream is open, and close
+    // every stream before the link goes.
+    virtual std::unique_ptr<LinkSocket> connect(bool isNode1, int resendTimes, unsigned stream = 0,
+                                                unsigned weight = 1) = 0;
+
+    // Whether transfer() compresses its data (on by default); data it cannot shrink goes raw anyway
+    virtual void setCompression(bool enabled) = 0;
+
+    [[nodiscard]] virtual unsigned maxBodyLength() const = 0;
+
+    // For LinkAudioBlock::configure()
+    [[nodiscard]] virtual CarrierSense carrierSense() const = 0;
+
+    // Samples per second of the rings in LinkIO, for LinkAudioBlock::setRates()
+    [[nodiscard]] virtual double sampleRate() const = 0;
+
+    // The highest tone the preamble and header put on air, in Hz: alternating base-rate bits, or
+    // the faster carrier with Config::BAND_SPLIT
+    [[nodiscard]] virtual double highestTone() const = 0;
+};
+
+// Whether frames of link survive the audio blocks' resampling to and from a device at deviceRate;
+// without it no preamble comes through and the handshake never answers
+inline bool carriesAt(const Link &link, double deviceRate) {
+    return std::lround(deviceRate) == std::lround(link.sampleRate()) ||
+           link.highestTone() < dsp::Resampler::passband(deviceRate, link.sampleRate());
+}
+
+template<class Config>
+class LinkImpl final : public Link {
+public:
+    explicit LinkImpl(const LinkIO &io, MacMode macMode) :
+            frames(framePool, io.lanes, io.stats),
+            writer(io.output, io.quiet, io.stats, io.lanes),
+            handshakes(&writer, io.stats),
+            mac(&frames, &writer, io.stats, &handshakes),
+            tdma(&frames, &writer, io.stats, &handshakes,
+                 macMode == MacMode::TdmaDemand ? SlotAllocation::Demand : SlotAllocation::Static),
+            mode(macMode), stats(io.stats) {
+        for (unsigned lane = 0; lane < io.lanes; ++lane)
+            receivers.push_back(std::make_unique<ReceivePipeline<Config>>(&io.input[lane], &frames, io.stats, 0,
+                                                                          lane, io.lanes));
+        for (auto &receiver: receivers) receiver->startThread();
+    }
+
+    ~LinkImpl() override {
+        for (auto &receiver: receivers) receiver->stopThread(1000);
+    }
+
+    bool handshake(bool isNode1, int resendTimes) override {
+        takeRole(isNode1);
+        return handshakes.connect(isNode1, &frames, resendTimes);
+    }
+
+    [[nodiscard]] Capabilities agreed() const override { return handshakes.agreed(); }
+
+    TransferResult transfer(bool isNode1, const std::string &data, int resendTimes) override {
+        if (!handshake(isNode1, resendTimes)) return {};
+        auto payload = encodePayload(data, compress);
+        // frame 1 carries the number of frames in its SEQType
+        auto maxBody = handshakes.agreed().maxBody;
+        auto frameCount = Config::transferFrames(payload.size(), maxBody);
+        if (frameCount > (size_t) std::numeric_limits<typename Config::SEQType>::max()) {
+            fprintf(stderr, "Transfer of %zu bytes needs too many frames of %u bytes!\n", payload.size(), maxBody);
+            return {};
+        }
+        return mode == MacMode::Csma ? mac.transfer(isNode1, payload, resendTimes)
+                                     : tdma.transfer(isNode1, payload, resendTimes);
+    }
+
+    TransferResult ping(const std::string &data, double timeout) override {
+        if (!handshake(true, PING_HANDSHAKE_ATTEMPTS)) return {};
+        return mac.ping(data, timeout);
+    }
+
+    std::unique_ptr<LinkSocket> connect(bool isNode1, int resendTimes, unsigned stream, unsigned weight) override {
+        auto shared = mux.lock();
+        if (shared == nullptr || !shared->isAlive()) {
+            takeRole(isNode1);
+            shared = std::make_shared<StreamMux<Config>>(&frames, &writer, stats, &handshakes, isNode1, resendTimes);
+            mux = shared;
+        }
+        if (!shared->open(stream, weight)) return nullptr;
+        return std::make_unique<MuxSocket<Config>>(shared, stream);
+    }
+
+    void setCompression(bool enabled) override { compress = enabled; }
+
+    [[nodiscard]] unsigned maxBodyLength() const override { return handshakes.agreed().maxBody; }
+
+    [[nodiscard]] CarrierSense carrierSense() const override {
+        return {(int) (Config::LENGTH_PREAMBLE * Config::LENGTH_OF_ONE_BIT), Config::NOISY_THRESHOLD,
+                Config::NOISE_MARGIN, Config::NOISE_FLOOR_RISE, Config::DC_BLOCKER_POLE};
+    }
+
+    [[nodiscard]] double sampleRate() const override { return Config::SAMPLE_RATE; }
+
+    [[nodiscard]] double highestTone() const override {
+        if constexpr (Config::BAND_SPLIT)
+            return (double) Config::SAMPLE_RATE / std::min(Config::BAND_PERIOD_NODE1, Config::BAND_PERIOD_NODE2);
+        return (double) Config::SAMPLE_RATE / Config::LENGTH_OF_ONE_BIT;
+    }
+
+private:
+    static constexpr int PING_HANDSHAKE_ATTEMPTS = 20; // macping keeps going without a resend limit
+
+    // With Config::BAND_SPLIT: send on this node's carrier and receive on the other one
+    void takeRole(bool isNode1) {
+        writer.setNode(isNode1);
+        for (auto &receiver: receivers) receiver->listenTo(!isNode1);
+    }
+
+    // received frames, from the receivers (one per lane) to whichever MAC runs
+    FramePool<Config> framePool;
+    FrameQueue<Config> frames;
+    std::vector<std::unique_ptr<ReceivePipeline<Config>>> receivers;
+    Writer<Config> writer;
+    Handshake<Config> handshakes;
+    Mac<Config> mac;
+    TdmaMac<Config> tdma;
+    MacMode mode;
+    LinkStats *stats;
+    bool compress{true};
+    std::weak_ptr<StreamMux<Config>> mux; // while a stream is open
+};
+
+// Builds the link for the configuration called name (see LINK_CONFIG_NAMES), nullptr if unknown
+inline std::unique_ptr<Link> makeLink(const std::string &name, const LinkIO &io, MacMode mode = MacMode::Csma) {
+    std::unique_ptr<Link> ret;
+    withLinkConfig(name, [&](auto config) { ret = std::make_unique<LinkImpl<decltype(config)>>(io, mode); });
+    return ret;
+}
+
+#endif//LINK_H
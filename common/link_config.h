@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+/* Compile-time configuration of the PHY and MAC shared by Part3 - Part5
+ *
+ * Reader, Writer and Mac are templates over one of these structs, so every constant below folds
+ * into the hot loops. Several configurations can be instantiated side by side and one of them is
+ * picked at startup by name, see withLinkConfig().
+ *
+ * Structure of a frame
+ * PREAMBLE
+ * LEN      the length of BODY; Len = 0: ACK or NACK
+ * SEQ      +x: Node1 frame, -x: Node2 frame; 16 bits, so one transfer() may take up to 32767 frames
+ * RATE     (low nibble) half the samples per bit of BODY and CRC
+ * STREAM   (high nibble) which stream of a LinkSocket BODY belongs to, 0 otherwise; 15 on a NACK
+ * HCRC     CRC-8 of LEN up to STREAM, so a frame whose BODY is damaged still tells its SEQ
+ * BODY
+ * CRC      CRC-32 of everything from LEN
+ *
+ * A bit is an even number of samples: the first half +1 and the second half -1 for a one, the
+ * other way round for a zero. PREAMBLE up to HCRC always go at LENGTH_OF_ONE_BIT samples per bit,
+ * BODY and CRC at any even number from 2 up to that, see rate.h. With BandSplit those samples key
+ * a carrier of the sending node's own instead, see band.h.
+ *
+ * Samples are at SampleRate, which the audio callback converts the device to if it runs at
+ * another one (audio_block.h); everything timed in seconds here is the same at any rate.
+ */
+
+template<unsigned BitLength, unsigned Mtu, unsigned WindowSize, bool BandSplit = false, unsigned SampleRate = 48000>
+struct LinkConfig {
+    using LENType = unsigned char;
+    using SEQType = int16_t;
+
+    static constexpr unsigned SAMPLE_RATE = SampleRate;
+    static constexpr unsigned LENGTH_OF_ONE_BIT = BitLength;
+    static constexpr double BIT_RATE = (double) SAMPLE_RATE / LENGTH_OF_ONE_BIT; // of the preamble and header
+    static constexpr unsigned MTU = Mtu;
+    static constexpr unsigned LENGTH_PREAMBLE = 3;
+    static constexpr unsigned LENGTH_LEN = sizeof(LENType);
+    static constexpr unsigned LENGTH_SEQ = sizeof(SEQType);
+    static constexpr unsigned LENGTH_RATE_STREAM = 1; // a nibble each, which leaves HCRC its byte
+    static constexpr unsigned LENGTH_HCRC = 1;
+    static constexpr unsigned LENGTH_CRC = sizeof(unsigned int);
+    static constexpr unsigned MAX_LENGTH_BODY = MTU - LENGTH_PREAMBLE - LENGTH_SEQ - LENGTH_LEN - LENGTH_RATE_STREAM -
+                                                LENGTH_HCRC - LENGTH_CRC;
+
+    static constexpr unsigned SLIDING_WINDOW_SIZE = WindowSize;
+    // With BandSplit nobody defers, so an ACK may queue behind a whole window of the peer's frames
+    static constexpr double ACK_QUEUE_SECONDS = BandSplit ? WindowSize * Mtu * 8.0 / BIT_RATE : 0;
+    static constexpr double SLIDING_WINDOW_TIMEOUT_NODE1 = 0.5 + ACK_QUEUE_SECONDS;
+    static constexpr double SLIDING_WINDOW_TIMEOUT_NODE2 = 0.4 + ACK_QUEUE_SECONDS;
+    // Fast retransmission (mac.h, socket.h): a receiver that gets a frame with a sound header and a
+    // damaged BODY answers with a NACK, a bodiless frame with this STREAM. The sender resends a
+    // frame at once on its NACK, or once this many later frames were acknowledged before it; the
+    // channel keeps frames in order, so one is enough.
+    static constexpr unsigned char NACK_STREAM = 0xff;
+    static constexpr int FAST_RETRANSMIT_ACKS = 1;
+
+    // Receive front end (reader.h): the input is DC-blocked first. A preamble sets the reference
+    // level, its mean difference between the two halves of a bit, which has to reach
+    // PREAMBLE_MIN_LEVEL; every half-bit difference of that preamble and of the frame after it has
+    // to clear SLICE_THRESHOLD times the level, so slicing does not depend on the volume.
+    static constexpr float DC_BLOCKER_POLE = 0.995f;
+    static constexpr float SLICE_THRESHOLD = 0.15f;
+    static constexpr float PREAMBLE_MIN_LEVEL = 0.02f;
+    // Carrier sense (audio_block.h): busy once the DC-blocked input peaks above NOISY_THRESHOLD and
+    // NOISE_MARGIN times the noise floor, which is learned with NOISE_FLOOR_RISE per audio block
+    static constexpr float NOISY_THRESHOLD = 0.01f;
+    static constexpr float NOISE_MARGIN = 4.0f;
+    static constexpr float NOISE_FLOOR_RISE = 0.002f;
+    // Rate adaptation (rate.h): SNR the payload needs at 2 samples per bit, 3 dB less for every
+    // doubling of that
+    static constexpr float RATE_MIN_SNR_DB = 12.0f;
+
+    // Band split (band.h): each node transmits on a carrier of its own, with this many samples per
+    // cycle (6 kHz and 16 kHz at 48 kHz), and the receiver band-passes the peer's with two biquads
+    // of BAND_Q. Both nodes then transmit at once, without listening first. A half-bit has to hold
+    // a cycle of the slower carrier, so only the base rate is left for the payload.
+    static constexpr bool BAND_SPLIT = BandSplit;
+    static constexpr int BAND_PERIOD_NODE1 = 8;
+    static constexpr int BAND_PERIOD_NODE2 = 3;
+    static constexpr double BAND_Q = 1.5;
+
+    // TDMA MAC (tdma.h): slots per superframe, shared by both nodes, and the idle time at the
+    // end of every turn that absorb the round trip through both sound cards
+    static constexpr unsigned TDMA_SLOTS = 12;
+    static constexpr double TDMA_GUARD_SECONDS = 0.02;
+    static constexpr unsigned TDMA_GUARD_SAMPLES = (unsigned) (TDMA_GUARD_SECONDS * SAMPLE_RATE);
+
+    // Streams (socket.h): how many a link carries, the bytes each one buffers on the receiving
+    // side, which is the credit the sender starts with, and how often a sender out of credit asks
+    // for more
+    static constexpr unsigned STREAMS = 8;
+    static constexpr unsigned STREAM_BUFFER = 16 * 1024;
+    static constexpr double CREDIT_PROBE_INTERVAL = 0.5;
+
+    static_assert(LENGTH_OF_ONE_BIT >= 2 && LENGTH_OF_ONE_BIT % 2 == 0, "a bit is two equal halves");
+    static_assert(MTU > LENGTH_PREAMBLE + LENGTH_SEQ + LENGTH_LEN + LENGTH_RATE_STREAM + LENGTH_HCRC + LENGTH_CRC,
+                  "no room for BODY");
+    static_assert(LENGTH_OF_ONE_BIT / 2 <= 15 && STREAMS < 15, "RATE and STREAM must fit in a nibble each");
+    static_assert(MAX_LENGTH_BODY <= 255, "LEN must fit in LENType");
+    static_assert(!BAND_SPLIT || LENGTH_OF_ONE_BIT / 2 >= BAND_PERIOD_NODE1, "a half-bit holds a carrier cycle");
+
+    static constexpr char preamble[LENGTH_PREAMBLE]{0x55, 0x55, 0x54};
+
+    // Frame layout in bytes from the start of the preamble
+    static constexpr unsigned OFFSET_LEN = LENGTH_PREAMBLE;
+    static constexpr unsigned OFFSET_SEQ = OFFSET_LEN + LENGTH_LEN;
+    static constexpr unsigned OFFSET_RATE_STREAM = OFFSET_SEQ + LENGTH_SEQ;
+    static constexpr unsigned OFFSET_HCRC = OFFSET_RATE_STREAM + LENGTH_RATE_STREAM;
+    static constexpr unsigned OFFSET_BODY = OFFSET_HCRC + LENGTH_HCRC;
+
+    static constexpr unsigned SAMPLES_PER_BYTE = 8 * LENGTH_OF_ONE_BIT;
+    static constexpr unsigned PREAMBLE_SAMPLES = LENGTH_PREAMBLE * SAMPLES_PER_BYTE;
+
+    // Samples per bit BODY and CRC may go at
+    static constexpr bool isPayloadBitLength(unsigned bitLength) {
+        if (BAND_SPLIT) return bitLength == LENGTH_OF_ONE_BIT;
+        return bitLength >= 2 && bitLength <= LENGTH_OF_ONE_BIT && bitLength % 2 == 0;
+    }
+
+    // Airtime of a frame with len bytes of BODY; at the base rate unless bitLength says otherwise
+    static constexpr unsigned frameSamples(unsigned len, unsigned bitLength = LENGTH_OF_ONE_BIT) {
+        return OFFSET_BODY * SAMPLES_PER_BYTE + (len + LENGTH_CRC) * 8 * bitLength;
+    }
+
+    // Frames transfer() sends for a payload of bytes (after encodePayload()): frame 1 with the count,
+    // then BODY after BODY; SEQ numbers them all
+    static constexpr size_t transferFrames(size_t bytes, unsigned maxBody = MAX_LENGTH_BODY) {
+        return (bytes + maxBody - 1) / maxBody + 1;
+    }
+
+    // How long samples of the link take to play, in microseconds
+    static constexpr uint64_t samplesToMicros(uint64_t samples) { return samples * 1000000 / SAMPLE_RATE; }
+
+    // The preamble unpacked to one bit per entry, LSB first like everything else on air
+    static constexpr std::array<int, LENGTH_PREAMBLE * 8> preambleBits = [] {
+        std::array<int, LENGTH_PREAMBLE * 8> ret{};
+        for (unsigned i = 0; i < LENGTH_PREAMBLE * 8; ++i) ret[i] = preamble[i / 8] >> (i % 8) & 1;
+        return ret;
+    }();
+};
+
+// The settings Part3 - Part5 were tuned with
+using DefaultLinkConfig = LinkConfig<4, 60, 3>;
+// Half the symbol length, for short and clean cables
+using FastLinkConfig = LinkConfig<2, 60, 3>;
+// Longer frames and a wider window for bulk transfers
+using BulkLinkConfig = LinkConfig<4, 200, 6>;
+// Both nodes at once on carriers of their own, for a shared medium such as air
+using DuplexLinkConfig = LinkConfig<16, 60, 3, true>;
+// The default frame at twice the bit rate, for a sound card running at 96 kHz or faster
+using HiresLinkConfig = LinkConfig<4, 60, 3, false, 96000>;
+
+constexpr const char *LINK_CONFIG_NAMES = "default, fast, bulk, duplex, hires";
+
+// What Part3 and Part4 transfer: INPUT.bin of the repository, plus the byte encodePayload() puts in
+// front; it does not compress, so every configuration has to number that many bytes of frames
+constexpr size_t INPUT_BIN_BYTES = 6250 + 1;
+
+template<class... Configs>
+constexpr bool countsInputBin() {
+    return ((Configs::transferFrames(INPUT_BIN_BYTES) <=
+             (size_t) std::numeric_limits<typename Configs::SEQType>::max()) && ...);
+}
+
+static_assert(countsInputBin<DefaultLinkConfig, FastLinkConfig, BulkLinkConfig, DuplexLinkConfig, HiresLinkConfig>(),
+              "SEQ must number every frame of INPUT.bin");
+
+// Audio channels one link can stripe its frames over, each with its own PHY: a stereo cable
+constexpr unsigned MAX_LANES = 2;
+
+// Calls f(Config{}) with the configuration called name; returns false if there is none
+template<class F>
+bool withLinkConfig(const std::string &name, F &&f) {
+    if (name.empty() || name == "default") {
+        f(DefaultLinkConfig{});
+    } else if (name == "fast") {
+        f(FastLinkConfig{});
+    } else if (name == "bulk") {
+        f(BulkLinkConfig{});
+    } else if (name == "duplex") {
+        f(DuplexLinkConfig{});
+    } else if (name == "hires") {
+        f(HiresLinkConfig{});
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Samples per second of the configuration called name, 0 if there is none
+inline unsigned linkSampleRate(const std::string &name) {
+    unsigned ret = 0;
+    withLinkConfig(name, [&](auto config) { ret = decltype(config)::SAMPLE_RATE; });
+    return ret;
+}
@@ -0,0 +1,136 @@
+#include "lz.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr unsigned HASH_BITS = 14;
+
+uint32_t read32(const char *p) {
+    uint32_t ret;
+    memcpy(&ret, p, 4);
+    return ret;
+}
+
+uint32_t hash(uint32_t sequence) { return sequence * 2654435761u >> (32 - HASH_BITS); }
+
+// 255 as long as more follow, then the rest
+void putLength(std::string &out, size_t length) {
+    for (; length >= 255; length -= 255) out.push_back((char) 255);
+    out.push_back((char) length);
+}
+
+void putSequence(std::string &out, const char *literals, size_t literalCount, size_t offset, size_t matchLength) {
+    auto matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    out.push_back((char) (std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(matchCode, 15)));
+    if (literalCount >= 15) putLength(out, literalCount - 15);
+    out.append(literals, literalCount);
+    if (matchLength == 0) return;
+    out.push_back((char) (offset & 0xff));
+    out.push_back((char) (offset >> 8));
+    if (matchCode >= 15) putLength(out, matchCode - 15);
+}
+
+}// namespace
+
+std::string lzCompress(const char *data, size_t size) {
+    std::string out;
+    out.reserve(size + size / 255 + 16);
+    auto size32 = (uint32_t) size;
+    out.append((const char *) &size32, 4);
+    // position + 1 of the last occurrence of every hashed 4-byte sequence, 0 for none
+    std::vector<uint32_t> table(1u << HASH_BITS, 0);
+    size_t anchor = 0, pos = 0;
+    while (pos + MIN_MATCH <= size) {
+        auto sequence = read32(data + pos);
+        auto &slot = table[hash(sequence)];
+        auto candidate = (size_t) slot;
+        slot = (uint32_t) (pos + 1);
+        if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || read32(data + candidate - 1) != sequence) {
+            ++pos;
+            continue;
+        }
+        auto from = candidate - 1;
+        auto length = MIN_MATCH;
+        while (pos + length < size && data[from + length] == data[pos + length]) ++length;
+        putSequence(out, data + anchor, pos - anchor, pos - from, length);
+        pos += length;
+        anchor = pos;
+    }
+    if (anchor < size) putSequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool LzDecoder::feed(const char *data, size_t size) {
+    size_t i = 0;
+    while (true) {
+        auto byte = [&] { return (unsigned char) data[i++]; };
+        switch (state) {
+            case State::Header:
+                if (i == size) return true;
+                total |= (uint32_t) byte() << 8 * got;
+                if (++got == 4) state = total == 0 ? State::Done : State::Token;
+                break;
+            case State::Token: {
+                if (i == size) return true;
+                auto token = byte();
+                literals = token >> 4;
+                match = (token & 15) + MIN_MATCH;
+                state = literals == 15 ? State::LiteralCount : State::Literals;
+                break;
+            }
+            case State::LiteralCount: {
+                if (i == size) return true;
+                auto more = byte();
+                literals += more;
+                if (more != 255) state = State::Literals;
+                break;
+            }
+            case State::Literals: {
+                if (literals > total - produced()) {
+                    state = State::Corrupt;
+                    break;
+                }
+                auto take = std::min(literals, size - i);
+                output.append(data + i, take);
+                i += take;
+                literals -= take;
+                if (literals > 0) return true;
+                got = 0;
+                offset = 0;
+                state = produced() == total ? State::Done : State::Offset;
+                break;
+            }
+            case State::Offset:
+                if (i == size) return true;
+                offset |= (size_t) byte() << 8 * got;
+                if (++got == 2) state = match == 15 + MIN_MATCH ? State::MatchLength : State::Match;
+                break;
+            case State::MatchLength: {
+                if (i == size) return true;
+                auto more = byte();
+                match += more;
+                if (more != 255) state = State::Match;
+                break;
+            }
+            case State::Match:
+                if (offset == 0 || offset > produced() || match > total - produced()) {
+                    state = State::Corrupt;
+                    break;
+                }
+                // byte by byte, a match may overlap what it produces
+                for (auto from = output.size() - offset; match > 0; --match) output.push_back(output[from++]);
+                state = produced() == total ? State::Done : State::Token;
+                break;
+            case State::Done:
+                if (i == size) return true;
+                state = State::Corrupt;
+                break;
+            case State::Corrupt:
+                return false;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* In-tree LZ77 codec for transfer payloads, LZ4-like
+ *
+ * Stream layout: uint32_t original size, then sequences of
+ *   token            high nibble: literal count, low nibble: match length - 4 (15: more bytes follow)
+ *   literal count    255 as long as more follow, then the rest
+ *   literals
+ *   uint16_t offset  how far back the match starts, 1 .. 65535
+ *   match length     255 as long as more follow, then the rest
+ * The last sequence may stop after its literals, once the original size is reached.
+ *
+ * No entropy coding: it only wins on repetitive data (text, logs, sparse binaries), and costs
+ * 4 bytes plus about 0.4% on data it cannot shrink.
+ */
+
+std::string lzCompress(const char *data, size_t size);
+
+// Decodes a stream fed in pieces of any size, appending to output as it goes
+class LzDecoder {
+public:
+    explicit LzDecoder(std::string &outputString) : output(outputString), base(outputString.size()) {}
+
+    // False once the stream turned out corrupt
+    bool feed(const char *data, size_t size);
+
+    // The whole original has been decoded
+    [[nodiscard]] bool done() const { return state == State::Done; }
+
+private:
+    enum class State { Header, Token, LiteralCount, Literals, Offset, MatchLength, Match, Done, Corrupt };
+
+    [[nodiscard]] size_t produced() const { return output.size() - base; }
+
+    std::string &output;
+    size_t base;
+    State state{State::Header};
+    uint32_t total{0};
+    unsigned got{0}; // bytes of the size or offset read so far
+    size_t literals{0}, match{0}, offset{0};
+};
@@ -0,0 +1,478 @@
+#ifndef MAC_H
+#define MAC_H
+
+#include "frame.h"
+#include "handshake.h"
+#include "lz.h"
+#include "pool.h"
+#include "rate.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+// The first byte of every transfer says how the rest of it is coded
+enum class PayloadCoding : char { Raw = 0, Lz = 1 };
+
+// What a transfer hands the MAC: compressed if asked to and if that makes it shorter
+inline std::string encodePayload(const std::string &data, bool compress) {
+    if (compress) {
+        auto packed = lzCompress(data.data(), data.size());
+        if (packed.size() < data.size()) return (char) PayloadCoding::Lz + packed;
+    }
+    return (char) PayloadCoding::Raw + data;
+}
+
+// Undoes encodePayload() piece by piece as the payload arrives, appending the original to data
+class PayloadDecoder {
+public:
+    explicit PayloadDecoder(std::string &data) : output(data), lz(data) {}
+
+    // False once the payload turned out corrupt
+    bool feed(const char *piece, size_t size) {
+        if (size > 0 && state == State::Coding) {
+            state = piece[0] == (char) PayloadCoding::Raw ? State::Raw
+                  : piece[0] == (char) PayloadCoding::Lz  ? State::Lz
+                                                          : State::Corrupt;
+            ++piece;
+            --size;
+        }
+        if (state == State::Raw) {
+            output.append(piece, size);
+        } else if (state == State::Lz && !lz.feed(piece, size)) {
+            state = State::Corrupt;
+        }
+        return state != State::Corrupt;
+    }
+
+    // The whole payload has been decoded
+    [[nodiscard]] bool done() const { return state == State::Raw || (state == State::Lz && lz.done()); }
+
+private:
+    enum class State { Coding, Raw, Lz, Corrupt };
+
+    std::string &output;
+    LzDecoder lz;
+    State state{State::Coding};
+};
+
+struct TransferResult {
+    bool ACKedAll = false;      // every frame we sent was acknowledged
+    bool receiveAll = false;    // every frame of the other node arrived
+    std::string received;       // data of the other node, decoded as its frames arrived in order
+    double receiveSeconds = 0;  // from the start until receiveAll
+    double totalSeconds = 0;
+    size_t receivedOnAir = 0;   // bytes the other node's payload took in frames, after compression
+
+    // Original bytes of the other node per second until receiveAll, in bits per second
+    [[nodiscard]] double goodput() const {
+        return receiveSeconds > 0 ? (double) received.size() * 8 / receiveSeconds : 0;
+    }
+};
+
+// Frame i of data cut into BODYs of at most maxBody bytes: frame 0 (SEQ 1) carries the number of
+// frames, frame i (SEQ i + 1) the i-th BODY. Built whenever it goes on air, so data is never copied whole.
+template<class Config>
+FrameType<Config> makeFrame(bool isNode1, const std::string &data, unsigned maxBody, size_t i) {
+    using Frame = FrameType<Config>;
+    using LENType = typename Config::LENType;
+    using SEQType = typename Config::SEQType;
+    auto seq = (SEQType) ((signed) (i + 1) * (isNode1 ? 1 : -1));
+    if (i == 0) {
+        auto frameNum = (SEQType) Config::transferFrames(data.size(), maxBody);
+        return Frame((LENType) Config::LENGTH_SEQ, seq, (const char *) &frameNum);
+    }
+    auto at = (i - 1) * maxBody;
+    return Frame((LENType) std::min<size_t>(maxBody, data.size() - at), seq, data.c_str() + at);
+}
+
+/* The other node's frames, put back in order
+ *
+ * A BODY goes to the PayloadDecoder as soon as every frame before it arrived. A frame ahead of a
+ * gap is copied into a ring of REORDER frames until the gap fills, so every handle goes back to the
+ * pool right away and a transfer may take as many frames as SEQ counts. A frame further ahead than
+ * the ring reaches is not taken, so it is not acknowledged either and the sender tries again.
+ */
+template<class Config>
+class Reassembly {
+public:
+    using Frame = FrameType<Config>;
+
+    // A window on every lane with CSMA; about two turns with TDMA, where a lost frame comes again next turn
+    static constexpr unsigned REORDER = 256;
+    static_assert(REORDER >= Config::SLIDING_WINDOW_SIZE * MAX_LANES && REORDER >= 4 * Config::TDMA_SLOTS,
+                  "the sender may run that far ahead of a lost frame");
+
+    Reassembly() : bodies(new char[REORDER * Config::MAX_LENGTH_BODY]), lengths(new unsigned char[REORDER]),
+                   held(new bool[REORDER]{}) {}
+
+    Reassembly(const Reassembly &) = delete;
+
+    // Starts a transfer, whose payload goes to payloadDecoder
+    void reset(PayloadDecoder *payloadDecoder) {
+        decoder = payloadDecoder;
+        std::fill(held.get(), held.get() + REORDER, false);
+        LFR = frameNum = 0;
+        onAir = 0;
+        corrupt = finished = false;
+    }
+
+    // Takes the frame with |SEQ| seqNum; false if it lies beyond the ring and must not be acknowledged
+    bool accept(unsigned seqNum, const Frame &frame) {
+        if (seqNum <= LFR) return true; // a repeat, its ACK got lost
+        if (seqNum > LFR + REORDER) return false;
+        auto slot = seqNum % REORDER;
+        if (!held[slot]) {
+            memcpy(&bodies[slot * Config::MAX_LENGTH_BODY], frame.body, frame.len);
+            lengths[slot] = (unsigned char) frame.len;
+            held[slot] = true;
+        }
+        for (slot = (LFR + 1) % REORDER; held[slot]; slot = (LFR + 1) % REORDER) {
+            held[slot] = false;
+            auto body = &bodies[slot * Config::MAX_LENGTH_BODY];
+            if (++LFR == 1) {
+                typename Config::SEQType count;
+                memcpy(&count, body, sizeof(count));
+                frameNum = (unsigned) count;
+            } else {
+                onAir += lengths[slot];
+                if (!decoder->feed(body, lengths[slot])) corrupt = true;
+            }
+        }
+        return true;
+    }
+
+    // Whether the frame with |SEQ| seqNum arrived already
+    [[nodiscard]] bool has(unsigned seqNum) const {
+        return seqNum <= LFR || (seqNum <= LFR + REORDER && held[seqNum % REORDER]);
+    }
+
+    // Once every frame arrived: fills in what result says about the payload; true the first time only
+    bool finish(TransferResult &result, double seconds) {
+        if (finished || LFR == 0 || LFR != frameNum) return false;
+        finished = true;
+        result.receiveSeconds = seconds;
+        result.receivedOnAir = onAir;
+        result.receiveAll = !corrupt && decoder->done();
+        if (!result.receiveAll) fprintf(stderr, "Received payload does not decode!\n");
+        return true;
+    }
+
+    [[nodiscard]] bool done() const { return finished; }
+
+private:
+    std::unique_ptr<char[]> bodies;          // REORDER slots of MAX_LENGTH_BODY, by |SEQ| modulo REORDER
+    std::unique_ptr<unsigned char[]> lengths;
+    std::unique_ptr<bool[]> held;
+    PayloadDecoder *decoder{nullptr};
+    unsigned LFR{0};      // every frame up to it went to the decoder
+    unsigned frameNum{0}; // frames the other node sends, from its frame 1
+    size_t onAir{0};
+    bool corrupt{false}, finished{false};
+};
+
+// Asks the other node to send its frame seq again
+template<class Config>
+FrameType<Config> makeNack(typename Config::SEQType seq) {
+    FrameType<Config> ret(0, seq, nullptr);
+    ret.stream = Config::NACK_STREAM;
+    return ret;
+}
+
+// Whether a frame still waiting for its ACK goes again before its timeout: at once on its NACK,
+// or once FAST_RETRANSMIT_ACKS later frames were acknowledged. Only after its last transmission
+// left the air, so one loss is answered once, and never with its last resend, which the timeout
+// keeps for reporting the link error.
+template<class Config>
+bool fastRetransmit(FrameWaitingInfo &waiting, bool nack) {
+    if (waiting.receiveACK || !waiting.aired || waiting.resendTimes <= 1) return false;
+    return nack || ++waiting.laterAcks >= Config::FAST_RETRANSMIT_ACKS;
+}
+
+// Sends a frame again at the rate picked now; its last transmission counts as a failure
+template<class Config>
+void sendAgain(Writer<Config> *writer, RateControl<Config> &rate, FrameType<Config> &frame,
+               FrameWaitingInfo &waiting) {
+    rate.report(frame.bitLength, false);
+    frame.bitLength = (unsigned char) rate.pick();
+    waiting.transmission = writer->send(frame);
+    waiting.timer.restart();
+    waiting.aired = false;
+    waiting.laterAcks = 0;
+    waiting.resendTimes--;
+}
+
+/* Sliding window MAC
+ *
+ * Both nodes send their own data and acknowledge the other one's at the same time. Frame 1 of each
+ * node carries the number of frames it sends; data frames start at 2. Node1 uses positive SEQ and
+ * Node2 negative SEQ, so each node can drop the echo of its own transmission.
+ *
+ * Data frames go at the payload rate RateControl picks: an ACK counts as a success of the rate
+ * the frame was last sent at, a timeout as a failure.
+ *
+ * A frame that arrives with a sound header and a damaged BODY is answered with a NACK, and a NACK
+ * or the ACK of a later frame makes the sender resend at once (fastRetransmit), so a loss costs
+ * about a round trip instead of the timeout.
+ *
+ * Every transfer runs with what the last handshake agreed on: frames of at most its maxBody, its
+ * window and its rates. Control frames (SEQ 0) go to the Handshake, so the other node may
+ * renegotiate at any time.
+ *
+ * With more than one lane the window grows by as many, and data frames are striped over the lanes
+ * by the Writer. An ACK or NACK goes back on the lane its frame came in on, so the order within a
+ * lane holds and fast retransmission only looks at older frames of the same lane.
+ *
+ * transfer() takes a payload from encodePayload() and hands back the other node's data decoded,
+ * see Reassembly, so received frames go back to the pool as soon as they are read. A frame we send
+ * is built by makeFrame when the window reaches it and kept in a ring of a window on every lane
+ * until it is acknowledged; nothing is allocated per transfer but the data received.
+ */
+template<class Config>
+class Mac {
+public:
+    using Frame = FrameType<Config>;
+    using LENType = typename Config::LENType;
+    using SEQType = typename Config::SEQType;
+
+    Mac() = delete;
+
+    Mac(const Mac &) = delete;
+
+    Mac(const Mac &&) = delete;
+
+    explicit Mac(FrameQueue<Config> *bufferIn, Writer<Config> *writerPtr, LinkStats *statsPtr,
+                 Handshake<Config> *handshakePtr) :
+            input(bufferIn), writer(writerPtr), stats(statsPtr), handshake(handshakePtr), rate(statsPtr),
+            sending(new Sending[IN_FLIGHT]) {}
+
+    // Send payload to the other node and receive its data; returns when both directions are done or the link breaks
+    TransferResult transfer(bool isNode1, const std::string &payload, int resendTimes) {
+        TransferResult result;
+        PayloadDecoder decoder(result.received);
+        received.reset(&decoder);
+        auto agreed = handshake->agreed();
+        auto frameNumSent = (unsigned) Config::transferFrames(payload.size(), agreed.maxBody);
+        trace::nameThread("MAC");
+        rate.reset();
+        rate.allow(agreed.rates);
+        writer->useLanes(agreed.lanes);
+        // every lane keeps a window's worth on air
+        unsigned window = std::min<unsigned>(agreed.window * agreed.lanes, IN_FLIGHT);
+        MyTimer testTotalTime;
+        unsigned LAR = 0, LFS = 0;
+        while (!result.ACKedAll || !received.done()) {
+            onAir(LAR, LFS);
+            // try to receive a frame or an ACK
+            for (FrameHandle<Config> frame; input->pop(frame);) {
+                auto seq = frame->seq;
+                // A SYN, or the SYN-ACK to a SYN we repeated
+                if (seq == 0) {
+                    handshake->handle(isNode1, *frame);
+                    continue;
+                }
+                auto seqNum = (unsigned) abs(seq);
+                bool mine = isNode1 == (seq > 0);
+                auto lane = frame->lane; // answers go back on it, so each lane keeps its order
+                // Its header is all we can trust: ask for it again unless we have it
+                if (frame->damaged) {
+                    if (frame->len != 0 && !mine && !received.has(seqNum)) {
+                        writer->send(makeNack<Config>(seq), OutputScheduler::ASAP, lane);
+                        TRACE(trace::Event::NackSent, seq);
+                        LinkStats::add(stats->nacksSent);
+                    }
+                    continue;
+                }
+                // It's a NACK
+                if (frame->isNack()) {
+                    if (mine && LAR < seqNum && seqNum <= LFS && fastRetransmit<Config>(slot(seqNum).waiting, true))
+                        fastResend(slot(seqNum), true);
+                    continue;
+                }
+                // It's a frame
+                if (frame->len != 0) {
+                    // ignore self sent
+                    if (mine)
+                        continue;
+                    TRACE(trace::Event::FrameReceived, seq);
+                    LinkStats::add(stats->framesReceived);
+                    rate.observeSnr(frame->snrDb);
+                    auto delivered = frame->deliveredMicros;
+                    // Accept this frame, its BODY goes on as soon as the ones before it did
+                    if (!received.accept(seqNum, *frame))
+                        continue;
+                    frame.reset();
+                    // send ACK
+                    writer->send(Frame(0, seq, nullptr), OutputScheduler::ASAP, lane);
+                    stats->latency.ackTurnaround.record(LatencyStats::elapsed(delivered));
+                    TRACE(trace::Event::AckSent, seq);
+                    LinkStats::add(stats->acksSent);
+                    // every frame from the other Node is received
+                    received.finish(result, testTotalTime.duration());
+                } else { // It's an ACK
+                    if (mine && LAR < seqNum && seqNum <= LFS && !slot(seqNum).waiting.receiveACK) {
+                        auto &acked = slot(seqNum);
+                        rate.observeSnr(frame->snrDb);
+                        rate.report(acked.frame.bitLength, true);
+                        acked.waiting.receiveACK = true;
+                        TRACE(trace::Event::AckReceived, seq, acked.waiting.resendTimes);
+                        LinkStats::add(stats->acksReceived);
+                        // frames stay in order on a lane, so an older one still waiting on it was lost
+                        for (unsigned older = LAR + 1; older < seqNum; ++older)
+                            if (writer->laneOf(slot(older).waiting.transmission) == lane &&
+                                fastRetransmit<Config>(slot(older).waiting, false))
+                                fastResend(slot(older), false);
+                    }
+                }
+            }
+            // update LAR
+            while (LAR < LFS && slot(LAR + 1).waiting.receiveACK) {
+                ++LAR;
+                // every frame to the other Node is ACKed
+                if (!result.ACKedAll && LAR == frameNumSent)
+                    result.ACKedAll = true;
+            }
+            // resend timeout frames
+            for (unsigned seq = LAR + 1; seq <= LFS; ++seq) {
+                auto &waiting = slot(seq).waiting;
+                if (waiting.receiveACK ||
+                    waiting.timer.duration() < (isNode1 ? Config::SLIDING_WINDOW_TIMEOUT_NODE1
+                                                        : Config::SLIDING_WINDOW_TIMEOUT_NODE2))
+                    continue;
+                if (waiting.resendTimes == 0) {
+                    TRACE(trace::Event::LinkError, (int32_t) seq);
+                    LinkStats::add(stats->linkErrors);
+                    fprintf(stderr, "Link error detected! frame seq = %d resend too many times...\n", seq);
+                    result.totalSeconds = testTotalTime.duration();
+                    return result;
+                }
+                sendAgain(writer, rate, slot(seq).frame, waiting);
+                TRACE(trace::Event::FrameResent, slot(seq).frame.seq, waiting.resendTimes);
+                LinkStats::add(stats->framesResent);
+            }
+            // try to update LFS and send a frame
+            if (LFS - LAR < window && LFS < frameNumSent) {
+                auto &next = slot(++LFS);
+                next.frame = makeFrame<Config>(isNode1, payload, agreed.maxBody, LFS - 1);
+                next.frame.bitLength = (unsigned char) rate.pick();
+                next.waiting = FrameWaitingInfo();
+                next.waiting.resendTimes = resendTimes;
+                // all of data was handed over at the start, so it has waited since then
+                stats->latency.macQueue.record((uint64_t) (testTotalTime.duration() * 1e6));
+                next.waiting.transmission = writer->send(next.frame);
+                TRACE(trace::Event::FrameSent, (int32_t) LFS);
+                LinkStats::add(stats->framesSent);
+                LinkStats::set(stats->windowInUse, LFS - LAR);
+            }
+        }
+        result.totalSeconds = testTotalTime.duration();
+        return result;
+    }
+
+    // macping on Node1: ping the other node every time it answers or after timeout seconds,
+    // and accept its frames meanwhile; returns once all of them arrived
+    TransferResult ping(const std::string &data, double timeout) {
+        TransferResult result;
+        PayloadDecoder decoder(result.received);
+        received.reset(&decoder);
+        auto agreed = handshake->agreed();
+        auto pingFrame = makeFrame<Config>(true, data, agreed.maxBody, 0);
+        writer->useLanes(agreed.lanes);
+        // send a PING frame first
+        trace::nameThread("MAC");
+        uint64_t pingId = writer->send(pingFrame);
+        uint64_t pingEnd = 0; // output sample the last ping finished playing at, 0 until it did
+        TRACE(trace::Event::PingSent, pingFrame.seq);
+        MyTimer pingTime;
+        MyTimer testTotalTime;
+        while (!received.done()) {
+            for (TransmissionReport report; writer->popReport(report);)
+                if (report.id == pingId) pingEnd = report.end;
+            // try to receive a frame or an ACK
+            for (FrameHandle<Config> frame; input->pop(frame);) {
+                if (frame->damaged || frame->isNack()) continue;
+                if (frame->seq == 0) {
+                    handshake->handle(true, *frame);
+                    continue;
+                }
+                auto seq = frame->seq;
+                auto seqNum = (unsigned) abs(seq);
+                auto lane = frame->lane;
+                // It's a frame
+                if (frame->len != 0) {
+                    // ignore self sent
+                    if (seq > 0) continue;
+                    TRACE(trace::Event::FrameReceived, seq);
+                    LinkStats::add(stats->framesReceived);
+                    auto delivered = frame->deliveredMicros;
+                    // Accept this frame, its BODY goes on as soon as the ones before it did
+                    if (!received.accept(seqNum, *frame)) continue;
+                    frame.reset();
+                    // send ACK
+                    writer->send(Frame(0, seq, nullptr), OutputScheduler::ASAP, lane);
+                    stats->latency.ackTurnaround.record(LatencyStats::elapsed(delivered));
+                    TRACE(trace::Event::AckSent, seq);
+                    LinkStats::add(stats->acksSent);
+                    // every frame from the other Node is received
+                    received.finish(result, testTotalTime.duration());
+                } else {// It's an ACK, repeat sending ping frame
+                    TRACE(trace::Event::PingReply, (int32_t) (pingTime.duration() * 1e6),
+                          pingEnd ? (int32_t) (writer->now() - pingEnd) : -1);
+                    pingId = writer->send(pingFrame);
+                    pingEnd = 0;
+                    TRACE(trace::Event::PingSent, pingFrame.seq);
+                    pingTime.restart();
+                }
+            }
+            if (pingTime.duration() > timeout) {
+                TRACE(trace::Event::PingTimeout);
+                pingId = writer->send(pingFrame);
+                pingEnd = 0;
+                TRACE(trace::Event::PingSent, pingFrame.seq);
+                pingTime.restart();
+            }
+        }
+        result.totalSeconds = testTotalTime.duration();
+        return result;
+    }
+
+private:
+    // A frame we sent and what it waits for, from the moment the window reaches it until its ACK
+    struct Sending {
+        Frame frame;
+        FrameWaitingInfo waiting;
+    };
+
+    static constexpr unsigned IN_FLIGHT = Config::SLIDING_WINDOW_SIZE * MAX_LANES;
+
+    Sending &slot(unsigned seq) { return sending[seq % IN_FLIGHT]; }
+
+    // Resend timeouts run from the moment a frame has actually left the air, not from when it was queued
+    void onAir(unsigned LAR, unsigned LFS) {
+        for (TransmissionReport report; writer->popReport(report);)
+            for (auto seq = LAR + 1; seq <= LFS; ++seq)
+                if (slot(seq).waiting.transmission == report.id) {
+                    slot(seq).waiting.timer.restart();
+                    slot(seq).waiting.aired = true;
+                }
+    }
+
+    void fastResend(Sending &again, bool nack) {
+        sendAgain(writer, rate, again.frame, again.waiting);
+        TRACE(trace::Event::FastRetransmit, again.frame.seq, again.waiting.resendTimes, nack);
+        LinkStats::add(stats->fastRetransmits);
+    }
+
+    FrameQueue<Config> *input{nullptr};
+    Writer<Config> *writer;
+    LinkStats *stats;
+    Handshake<Config> *handshake;
+    RateControl<Config> rate;
+    std::unique_ptr<Sending[]> sending; // IN_FLIGHT of them, by SEQ modulo IN_FLIGHT
+    Reassembly<Config> received;
+};
+
+#endif//MAC_H
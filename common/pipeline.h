@@ -0,0 +1,314 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "band.h"
+#include "dsp.h"
+#include "frame.h"
+#include "pool.h"
+#include "reader.h"
+#include "ring.h"
+#include "stats.h"
+#include "trace.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* Staged receiver: one detector thread and a pool of decoder threads
+ *
+ * The detector copies the DC-blocked input (demodulated first with Config::BAND_SPLIT, see band.h)
+ * into a history ring and runs the preamble matcher on every sample. Each hit becomes a candidate
+ * (the position right after the preamble and what the preamble measured, which sets the slicing
+ * threshold of the frame) and goes to the decoders round-robin through SPSC rings. A decoder
+ * slices the frame straight out of the history into a pooled frame (pool.h), waiting for samples
+ * that have not arrived yet, and answers through its own SPSC ring; a delivered frame goes on to
+ * the MAC by handle, without being copied again. An idle decoder sleeps on its WaitableEvent,
+ * which the detector signals when it hands it a candidate or writes more history. The detector
+ * sleeps on its own while it waits for an answer, which the decoders signal; the audio callback
+ * must not lock, so while the input is empty the detector looks at it again every INPUT_WAIT_MS.
+ *
+ * Candidates wait in a local list while every decoder is busy; they are only dropped (and counted)
+ * once that list is full, so a slow pool never stalls the input. Because candidate i always goes
+ * to decoder i % n and every decoder works in order, the detector collects the answers in
+ * candidate order as well. It delivers a frame whose CRC matched unless
+ * it starts inside the previous delivered one, so a preamble matched at two neighbouring samples
+ * yields one frame; one whose header alone checked out goes on marked damaged, so the MAC can ask
+ * for it again. The history is never overwritten while the oldest uncollected candidate may
+ * still read it.
+ */
+template<class Config>
+class ReceivePipeline {
+public:
+    using Frame = FrameType<Config>;
+
+    ReceivePipeline() = delete;
+
+    ReceivePipeline(const ReceivePipeline &) = delete;
+
+    ReceivePipeline(const ReceivePipeline &&) = delete;
+
+    // decoders = 0 picks one per spare core, shared by lanes pipelines; frames go out marked with lane
+    explicit ReceivePipeline(SampleRing *bufferIn, FrameQueue<Config> *bufferOut, LinkStats *statsPtr,
+                             unsigned decoders = 0, unsigned lane = 0, unsigned lanes = 1) :
+            detector(*this), input(bufferIn), output(bufferOut), stats(statsPtr), laneIndex((unsigned char) lane) {
+        if (decoders == 0)
+            decoders = std::max((std::clamp(std::thread::hardware_concurrency(), 2u, MAX_DECODERS + 1) - 1) / lanes,
+                                1u);
+        for (unsigned i = 0; i < std::min(decoders, MAX_DECODERS); ++i)
+            pool.push_back(std::make_unique<Decoder>(*this, i));
+        fprintf(stderr, "    Receive Pipeline Start (%zu decoders)\n", pool.size());
+    }
+
+    ~ReceivePipeline() { stopThread(1000); }
+
+    void startThread() {
+        for (auto &decoder: pool) decoder->startThread();
+        detector.startThread();
+    }
+
+    void stopThread(int timeOutMilliseconds) {
+        detector.signalThreadShouldExit();
+        detector.wake.signal();
+        for (auto &decoder: pool) {
+            decoder->signalThreadShouldExit();
+            decoder->wake.signal();
+        }
+        detector.stopThread(timeOutMilliseconds);
+        for (auto &decoder: pool) decoder->stopThread(timeOutMilliseconds);
+    }
+
+    [[nodiscard]] size_t decoders() const { return pool.size(); }
+
+    // With Config::BAND_SPLIT, which node's carrier to receive from now on; Node1's until told otherwise
+    void listenTo(bool senderIsNode1) { peer.store(senderIsNode1, std::memory_order_relaxed); }
+
+private:
+    static constexpr unsigned MAX_DECODERS = 8;
+    static constexpr size_t CANDIDATE_RING = 16;  // per decoder
+    static constexpr size_t PENDING = 1024;       // candidates detected but not collected
+    static constexpr size_t HISTORY = 1 << 17;    // samples
+    static constexpr size_t INPUT_BATCH = 1024;   // samples taken from the input at once
+    static constexpr int IDLE_WAIT_MS = 50;       // an idle thread checks threadShouldExit() at least this often
+    static constexpr int INPUT_WAIT_MS = 1;       // the detector, while the input is empty
+    // A candidate that has not finished after this many samples is abandoned, so a false
+    // preamble in front of silence cannot stall the pipeline
+    static constexpr uint64_t MAX_SPAN = 2 * Config::frameSamples(Config::MAX_LENGTH_BODY);
+    static_assert(HISTORY > MAX_SPAN + INPUT_BATCH && HISTORY > Config::PREAMBLE_SAMPLES);
+
+    struct Candidate {
+        uint64_t start;
+        PreambleMeasure preamble;
+        uint64_t detectedMicros; // LatencyStats::now() at the match
+    };
+
+    struct Result {
+        DecodeStatus status;
+        uint64_t end;  // one past the last sample read
+        int len, seq;  // as far as they were read
+        Frame *frame;  // pooled, owned by the result; only if delivered or damaged and the pool had one
+    };
+
+    class Decoder : public Thread {
+    public:
+        Decoder(ReceivePipeline &owner, unsigned index) : Thread("Decoder " + String(index)), pipeline(owner) {}
+
+        void run() override {
+            trace::nameThread("Decoder");
+            while (!threadShouldExit()) {
+                Candidate candidate;
+                if (!candidates.pop(candidate)) {
+                    wake.wait(IDLE_WAIT_MS);
+                    continue;
+                }
+                auto start = candidate.start;
+                uint64_t position = start, available = 0;
+                auto next = [&](float &sample) {
+                    if (position - start >= MAX_SPAN) return false;
+                    while (position >= available) {
+                        if (threadShouldExit()) return false;
+                        available = pipeline.written.load(std::memory_order_acquire);
+                        if (position >= available) wake.wait(IDLE_WAIT_MS);
+                    }
+                    sample = pipeline.history[position++ & (HISTORY - 1)];
+                    return true;
+                };
+                // a frame whose candidate failed is cleared and used for the next one
+                if (frame) *frame = Frame();
+                else frame = pipeline.output->framePool().acquire();
+                auto &target = frame ? *frame : spare;
+                result.status = decodeFrame<Config>(next, target, candidate.preamble);
+                target.detectedMicros = candidate.detectedMicros;
+                target.decodedMicros = LatencyStats::now();
+                result.end = position;
+                result.len = target.len;
+                result.seq = target.seq;
+                auto deliver = result.status == DecodeStatus::Delivered || result.status == DecodeStatus::DiscardCRC;
+                result.frame = deliver ? frame.release() : nullptr;
+                while (!results.push(result))
+                    if (threadShouldExit()) {
+                        if (result.frame) pipeline.output->framePool().adopt(result.frame);
+                        return;
+                    }
+                pipeline.detector.wake.signal();
+            }
+        }
+
+        SpscRing<Candidate, CANDIDATE_RING> candidates;
+        SpscRing<Result, CANDIDATE_RING> results;
+        WaitableEvent wake; // a candidate or more history arrived, or the thread should exit
+
+    private:
+        ReceivePipeline &pipeline;
+        Result result{};
+        FrameHandle<Config> frame;
+        Frame spare; // decoded into when the pool is empty, to report the candidate all the same
+    };
+
+    class Detector : public Thread {
+    public:
+        explicit Detector(ReceivePipeline &owner) : Thread("Detector"), pipeline(owner) {}
+
+        void run() override { pipeline.detect(); }
+
+        WaitableEvent wake; // a decoder answered, or the thread should exit
+
+    private:
+        ReceivePipeline &pipeline;
+    };
+
+    void detect() {
+        assert(input != nullptr);
+        assert(output != nullptr);
+        trace::nameThread("Detector");
+        std::vector<float> batch(INPUT_BATCH);
+        dsp::DcBlocker dcBlocker(Config::DC_BLOCKER_POLE);
+        BandDemodulator<Config> demodulator;
+        uint64_t position = 0, holdOff = 0;
+        PreambleMeasure preamble;
+        while (!detector.threadShouldExit()) {
+            auto batchSize = input->pop(batch.data(), INPUT_BATCH);
+            if (batchSize == 0) {
+                collect(false);
+                detector.wake.wait(INPUT_WAIT_MS);
+                continue;
+            }
+            if constexpr (Config::BAND_SPLIT) {
+                auto senderIsNode1 = peer.load(std::memory_order_relaxed);
+                if (demodulator.tunedTo() != senderIsNode1) demodulator.tune(senderIsNode1);
+            }
+            for (size_t b = 0; b < batchSize; ++b) {
+                auto sample = batch[b];
+                if constexpr (Config::BAND_SPLIT) sample = demodulator.processSample(sample);
+                sample = dcBlocker.processSample(sample);
+                // never overwrite samples the oldest candidate may still need
+                if (collected < detected && position >= starts[collected % PENDING].start + HISTORY) {
+                    publish(position);
+                    while (collected < detected && position >= starts[collected % PENDING].start + HISTORY)
+                        if (!collect(true)) return;
+                }
+                history[position & (HISTORY - 1)] = sample;
+                ++position;
+                if (position < Config::PREAMBLE_SAMPLES || position < holdOff) continue;
+                auto window = position - Config::PREAMBLE_SAMPLES;
+                if (!matchPreamble<Config>([&](unsigned i) { return history[(window + i) & (HISTORY - 1)]; }, preamble))
+                    continue;
+                TRACE(trace::Event::PreambleDetected, (int32_t) (preamble.level * 1e6f), (int32_t) (preamble.snrDb * 10));
+                LinkStats::add(stats->preamblesDetected);
+                LinkStats::set(stats->preambleLevelMicro, (int64_t) (preamble.level * 1e6f));
+                // how far behind the audio callback the match is: the samples that came in after it
+                stats->latency.detect.record(Config::samplesToMicros(input->size() + batchSize - b - 1));
+                // with drift or a soft edge the same preamble can match at the next few samples too
+                holdOff = position + Config::LENGTH_OF_ONE_BIT;
+                if (detected - collected == PENDING) {
+                    TRACE(trace::Event::CandidateDropped);
+                    LinkStats::add(stats->candidatesDropped);
+                    continue;
+                }
+                starts[detected++ % PENDING] = {position, preamble, LatencyStats::now()};
+            }
+            publish(position);
+            collect(false);
+        }
+    }
+
+    // Makes the history up to position visible to the decoders and wakes those that may wait for it
+    void publish(uint64_t position) {
+        written.store(position, std::memory_order_release);
+        for (auto id = collected; id < dispatched && id < collected + pool.size(); ++id)
+            pool[id % pool.size()]->wake.signal();
+    }
+
+    // Hands waiting candidates to the decoders, round-robin, as long as they have room
+    void dispatch() {
+        for (; dispatched < detected; ++dispatched) {
+            auto &decoder = *pool[dispatched % pool.size()];
+            if (!decoder.candidates.push(starts[dispatched % PENDING])) break;
+            decoder.wake.signal();
+        }
+    }
+
+    // Takes the answers that are ready, in candidate order; with wait, blocks for at least one.
+    // Returns false if the pipeline is stopping.
+    bool collect(bool wait) {
+        while (collected < detected) {
+            dispatch();
+            auto &decoder = *pool[collected % pool.size()];
+            if (collected == dispatched || !decoder.results.pop(result)) {
+                if (!wait) return true;
+                if (detector.threadShouldExit()) return false;
+                detector.wake.wait(IDLE_WAIT_MS);
+                continue;
+            }
+            auto start = starts[collected++ % PENDING].start;
+            wait = false;
+            auto frame = result.frame ? output->framePool().adopt(result.frame) : FrameHandle<Config>();
+            if (result.status == DecodeStatus::Delivered && start < deliveredEnd) {
+                TRACE(trace::Event::DuplicateFrame, result.len, result.seq);
+                LinkStats::add(stats->duplicateFrames);
+                continue;
+            }
+            if (result.status == DecodeStatus::Aborted && result.end - start >= MAX_SPAN) {
+                TRACE(trace::Event::CandidateOverrun, result.len, result.seq);
+                LinkStats::add(stats->candidateOverruns);
+            }
+            if (result.status == DecodeStatus::Delivered) {
+                deliveredEnd = result.end;
+                if (frame) {
+                    frame->receivedAt = start;
+                    frame->lane = laneIndex;
+                }
+                deliverFrame(output, frame, result.len, result.seq, stats);
+            } else if (result.status == DecodeStatus::DiscardCRC && start >= deliveredEnd) {
+                if (frame) {
+                    frame->receivedAt = start;
+                    frame->damaged = true;
+                    frame->lane = laneIndex;
+                }
+                deliverFrame(output, frame, result.len, result.seq, stats);
+            }
+            countDecode(result.status, result.len, result.seq, stats);
+        }
+        return true;
+    }
+
+    Detector detector;
+    std::vector<std::unique_ptr<Decoder>> pool;
+
+    // Written by the detector only
+    std::unique_ptr<float[]> history{new float[HISTORY]};
+    std::atomic<uint64_t> written{0};
+    // Candidate ids: collected <= dispatched <= detected, starts[id % PENDING] is each candidate
+    std::unique_ptr<Candidate[]> starts{new Candidate[PENDING]};
+    uint64_t detected{0}, dispatched{0}, collected{0}, deliveredEnd{0};
+    Result result{};
+
+    SampleRing *input{nullptr};
+    FrameQueue<Config> *output{nullptr};
+    LinkStats *stats;
+    unsigned char laneIndex;
+    std::atomic<bool> peer{true}; // whose carrier, see listenTo()
+};
+
+#endif//PIPELINE_H
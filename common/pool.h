@@ -0,0 +1,185 @@
+#pragma once
+
+#include "frame.h"
+#include "ring.h"
+#include "stats.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/* Preallocated frames, passed between threads by handle
+ *
+ * FramePool allocates all of its frames up front. acquire() hands one out as a FrameHandle, which
+ * owns it like a unique_ptr and gives it back when it goes; acquire() and the release never block
+ * or allocate and may run on any thread (a Treiber stack whose top carries a tag against ABA).
+ * FrameQueue moves handles from the receivers to the MAC through an SPSC ring per lane, so a frame
+ * is demodulated straight into its pooled buffer and never copied on its way up.
+ */
+
+template<class Config>
+class FramePool;
+
+template<class Config>
+class FrameHandle {
+public:
+    using Frame = FrameType<Config>;
+
+    FrameHandle() = default;
+
+    FrameHandle(const FrameHandle &) = delete;
+
+    FrameHandle(FrameHandle &&other) noexcept : pool(other.pool), frame(other.release()) {}
+
+    FrameHandle &operator=(FrameHandle &&other) noexcept {
+        if (this != &other) {
+            reset();
+            pool = other.pool;
+            frame = other.release();
+        }
+        return *this;
+    }
+
+    ~FrameHandle() { reset(); }
+
+    Frame *operator->() const { return frame; }
+
+    Frame &operator*() const { return *frame; }
+
+    explicit operator bool() const { return frame != nullptr; }
+
+    // Gives the frame back to the pool now
+    void reset() {
+        if (frame != nullptr) pool->release(frame);
+        frame = nullptr;
+    }
+
+    // Stops owning the frame, e.g. to pass it through a ring; FramePool::adopt() takes it back
+    Frame *release() {
+        auto ret = frame;
+        frame = nullptr;
+        return ret;
+    }
+
+private:
+    friend class FramePool<Config>;
+
+    FrameHandle(FramePool<Config> *owner, Frame *pooled) : pool(owner), frame(pooled) {}
+
+    FramePool<Config> *pool{nullptr};
+    Frame *frame{nullptr};
+};
+
+template<class Config>
+class FramePool {
+public:
+    using Frame = FrameType<Config>;
+
+    // The FrameQueue rings of two lanes full; the MACs copy a frame out and give it back at once
+    static constexpr uint32_t DEFAULT_CAPACITY = 512;
+
+    explicit FramePool(uint32_t capacity = DEFAULT_CAPACITY) :
+            frames(new Frame[capacity]), links(new std::atomic<uint32_t>[capacity]), free(capacity) {
+        for (uint32_t i = 0; i < capacity; ++i) links[i].store(i + 1 < capacity ? i + 2 : 0, std::memory_order_relaxed);
+        top.store(capacity ? 1 : 0, std::memory_order_release);
+    }
+
+    FramePool(const FramePool &) = delete;
+
+    // A cleared frame, or an empty handle if all of them are out
+    FrameHandle<Config> acquire() {
+        auto head = top.load(std::memory_order_acquire);
+        while (true) {
+            auto slot = (uint32_t) head;
+            if (slot == 0) return {};
+            auto next = ((head >> 32) + 1) << 32 | links[slot - 1].load(std::memory_order_relaxed);
+            if (top.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                free.fetch_sub(1, std::memory_order_relaxed);
+                frames[slot - 1] = Frame();
+                return {this, &frames[slot - 1]};
+            }
+        }
+    }
+
+    // Owns a frame again that FrameHandle::release() let go of
+    FrameHandle<Config> adopt(Frame *frame) { return {this, frame}; }
+
+    [[nodiscard]] uint32_t available() const { return free.load(std::memory_order_relaxed); }
+
+private:
+    friend class FrameHandle<Config>;
+
+    void release(Frame *frame) {
+        auto slot = (uint32_t) (frame - frames.get()) + 1;
+        auto head = top.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            links[slot - 1].store((uint32_t) head, std::memory_order_relaxed);
+            next = ((head >> 32) + 1) << 32 | slot;
+        } while (!top.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+        free.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<Frame[]> frames;
+    // Free list: slot numbers are indices + 1 and 0 ends the list; top carries a tag in its high half
+    std::unique_ptr<std::atomic<uint32_t>[]> links;
+    std::atomic<uint64_t> top{0};
+    std::atomic<uint32_t> free;
+};
+
+// Receivers to MAC: one thread per lane pushes the frames that arrived on it, one thread at a time
+// pops them from all lanes in turn
+template<class Config>
+class FrameQueue {
+public:
+    static constexpr size_t CAPACITY = 256; // per lane
+
+    // With statsPtr, pop() stamps deliveredMicros and times the deliver stage of LatencyStats
+    explicit FrameQueue(FramePool<Config> &framePool, unsigned laneCount = 1, LinkStats *statsPtr = nullptr) :
+            pool(framePool), rings(new Ring[laneCount]), lanes(laneCount), stats(statsPtr) {}
+
+    FrameQueue(const FrameQueue &) = delete;
+
+    ~FrameQueue() {
+        stats = nullptr; // nobody takes these
+        for (FrameHandle<Config> frame; pop(frame);) {}
+    }
+
+    // Takes the frame unless the ring of its lane is full
+    bool push(FrameHandle<Config> &frame) {
+        if (!rings[frame->lane].push(&*frame)) return false;
+        frame.release();
+        return true;
+    }
+
+    bool pop(FrameHandle<Config> &frame) {
+        FrameType<Config> *pooled;
+        for (unsigned i = 0; i < lanes; ++i, next = (next + 1) % lanes) {
+            if (!rings[next].pop(pooled)) continue;
+            frame = pool.adopt(pooled);
+            next = (next + 1) % lanes;
+            if (stats != nullptr) {
+                frame->deliveredMicros = LatencyStats::now();
+                stats->latency.deliver.record(frame->deliveredMicros - frame->decodedMicros);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool empty() const {
+        for (unsigned i = 0; i < lanes; ++i)
+            if (!rings[i].empty()) return false;
+        return true;
+    }
+
+    [[nodiscard]] FramePool<Config> &framePool() const { return pool; }
+
+private:
+    using Ring = SpscRing<FrameType<Config> *, CAPACITY>;
+
+    FramePool<Config> &pool;
+    std::unique_ptr<Ring[]> rings;
+    unsigned lanes;
+    LinkStats *stats;
+    unsigned next{0}; // consumer side: the lane popped from first
+};
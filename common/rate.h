@@ -0,0 +1,109 @@
+#pragma once
+
+#include "stats.h"
+#include "trace.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+/* Payload rate selection for one peer, after Minstrel
+ *
+ * The preamble and the header always go at Config::LENGTH_OF_ONE_BIT samples per bit, BODY and
+ * CRC at any even bit length from 2 up to that, named in RATE. For each of those rates this keeps
+ * an EWMA of how many data frames sent at it were acknowledged, and pick() returns the rate with
+ * the best expected goodput: that probability over the airtime of an MTU frame. Every
+ * PROBE_INTERVAL-th pick tries the next faster rate instead, so a link that got better is noticed.
+ *
+ * A rate needs Config::RATE_MIN_SNR_DB at 2 samples per bit and 3 dB less for each doubling. Rates
+ * the peer's frames are heard too weak for (their preambles measure the SNR, see observeSnr())
+ * are neither picked nor probed, and neither are those the handshake did not agree on (allow()) or
+ * the configuration does not have; the base rate is always allowed. Frames that are not data, like
+ * ACKs and control frames, keep the base rate.
+ */
+template<class Config>
+class RateControl {
+public:
+    static constexpr unsigned RATES = Config::LENGTH_OF_ONE_BIT / 2;
+
+    // Rate r is 2 (r + 1) samples per bit, the last one is the base rate
+    static constexpr unsigned bitLength(unsigned rate) { return 2 * (rate + 1); }
+
+    explicit RateControl(LinkStats *statsPtr) : stats(statsPtr) { reset(); }
+
+    // Forget everything, e.g. at the start of a transfer
+    void reset() {
+        success.fill(PRIOR);
+        success[RATES - 1] = 1;
+        picks = 0;
+        snr = 0;
+        measured = false;
+        best = RATES - 1;
+        LinkStats::set(stats->payloadBitLength, bitLength(best));
+        update();
+    }
+
+    // The bit length of the next data frame
+    unsigned pick() {
+        if (++picks % PROBE_INTERVAL == 0 && best > 0 && allowed(best - 1)) return bitLength(best - 1);
+        return bitLength(best);
+    }
+
+    // Whether a data frame last sent at bitLength got through before it had to be sent again
+    void report(unsigned length, bool delivered) {
+        if (!Config::isPayloadBitLength(length)) return;
+        auto &p = success[length / 2 - 1];
+        p += ALPHA * ((delivered ? 1.0f : 0.0f) - p);
+        update();
+    }
+
+    // Only picks bit lengths b whose bit b is set in bitLengths from now on; reset() keeps this
+    void allow(uint32_t bitLengths) {
+        mask = bitLengths;
+        update();
+    }
+
+    // SNR of a frame heard from the peer
+    void observeSnr(float db) {
+        snr = measured ? snr + ALPHA * (db - snr) : db;
+        measured = true;
+        LinkStats::set(stats->peerSnrDb, (int64_t) std::lround(snr));
+        update();
+    }
+
+private:
+    static constexpr float ALPHA = 0.25f;       // EWMA weight of the newest observation
+    static constexpr float PRIOR = 0.75f;       // success assumed for rates never tried
+    static constexpr unsigned PROBE_INTERVAL = 10;
+
+    [[nodiscard]] bool allowed(unsigned rate) const {
+        auto needed = Config::RATE_MIN_SNR_DB - 3.0f * std::log2((float) bitLength(rate) / 2);
+        return rate == RATES - 1 || (Config::isPayloadBitLength(bitLength(rate)) && mask >> bitLength(rate) & 1u &&
+                                     (!measured || snr >= needed));
+    }
+
+    void update() {
+        unsigned next = RATES - 1;
+        float bestGoodput = 0;
+        for (unsigned rate = 0; rate < RATES; ++rate) {
+            if (!allowed(rate)) continue;
+            auto goodput = success[rate] / (float) Config::frameSamples(Config::MAX_LENGTH_BODY, bitLength(rate));
+            if (goodput > bestGoodput) {
+                bestGoodput = goodput;
+                next = rate;
+            }
+        }
+        if (next == best) return;
+        best = next;
+        TRACE(trace::Event::RateChanged, (int32_t) bitLength(best), (int32_t) std::lround(snr * 10),
+              (int32_t) std::lround(success[best] * 100));
+        LinkStats::set(stats->payloadBitLength, bitLength(best));
+    }
+
+    LinkStats *stats;
+    std::array<float, RATES> success{};
+    unsigned picks{0};
+    unsigned best{RATES - 1};
+    float snr{0};
+    bool measured{false};
+    uint32_t mask{~0u}; // bit lengths the peer takes
+};
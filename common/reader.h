@@ -0,0 +1,260 @@
+#ifndef READER_H
+#define READER_H
+
+#include "band.h"
+#include "dsp.h"
+#include "frame.h"
+#include "pool.h"
+#include "ring.h"
+#include "stats.h"
+#include "trace.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <ostream>
+
+// 1 or 0 if the first half of a bit is above or below the second by more than threshold, else -1
+inline int judgeBit(float signal1, float signal2, float threshold) {
+    if (signal1 - signal2 > threshold)
+        return 1;
+    else if (signal2 - signal1 > threshold)
+        return 0;
+    else return -1;
+}
+
+// Preambles heard without any noise measure this
+constexpr float MAX_SNR_DB = 60.0f;
+
+// Why a frame candidate was given up, or Delivered if its CRC matched
+enum class DecodeStatus { Delivered, DiscardLength, DiscardCRC, Aborted };
+
+// What a preamble tells about the frame behind it
+struct PreambleMeasure {
+    float level = 0; // mean difference between the two halves of a bit, see LinkConfig
+    float snrDb = 0; // per sample, from the spread of those differences
+};
+
+// Whether the window at(0) .. at(PREAMBLE_SAMPLES - 1) holds the preamble, and its measure.
+// Most windows fail on the sign of their first bits, before anything is computed.
+template<class Config, class At>
+bool matchPreamble(At &&at, PreambleMeasure &measure) {
+    constexpr unsigned L = Config::LENGTH_OF_ONE_BIT;
+    constexpr unsigned N = Config::preambleBits.size();
+    float difference[N];
+    float sum = 0;
+    for (unsigned i = 0; i < N; ++i) {
+        auto d = at(i * L) - at(i * L + L / 2);
+        if ((d > 0) != (Config::preambleBits[i] == 1)) return false;
+        difference[i] = std::fabs(d);
+        sum += difference[i];
+    }
+    auto level = sum / (float) N;
+    if (level < Config::PREAMBLE_MIN_LEVEL) return false;
+    float spread = 0;
+    for (auto d: difference) {
+        if (d <= Config::SLICE_THRESHOLD * level) return false;
+        spread += (d - level) * (d - level);
+    }
+    // a difference is twice the amplitude plus the difference of two noise samples
+    auto noisePower = spread / (float) (N - 1) / 2;
+    measure.level = level;
+    measure.snrDb = noisePower > 0 ? std::min(10 * std::log10(level * level / 4 / noisePower), MAX_SNR_DB) : MAX_SNR_DB;
+    return true;
+}
+
+// The slicing threshold for a frame whose preamble had level
+template<class Config>
+float sliceThreshold(float level) { return Config::SLICE_THRESHOLD * level; }
+
+// Slices one byte of bitLength samples per bit from the samples handed out by next(float &),
+// which returns false to give up
+template<class Config, class Next>
+bool sliceByte(Next &next, char &byte, float threshold, unsigned L = Config::LENGTH_OF_ONE_BIT) {
+    float buffer[Config::LENGTH_OF_ONE_BIT];
+    unsigned bufferPos = 0, bitPos = 0;
+    byte = 0;
+    while (next(buffer[bufferPos])) {
+        if (++bufferPos == L) {
+            int bit = judgeBit(buffer[0], buffer[L / 2], threshold);
+            if (bit == -1) { // shift by one sample
+                for (unsigned i = 1; i < L; ++i)
+                    buffer[i - 1] = buffer[i];
+                --bufferPos;
+                continue;
+            }
+            bufferPos = 0;
+            byte = (char) (byte | (bit << bitPos));
+            if (++bitPos == 8) return true;
+        }
+    }
+    return false;
+}
+
+// Reads LEN, SEQ, RATE, STREAM, HCRC, BODY and CRC of the frame that follows a preamble. DiscardCRC
+// leaves a header that HCRC vouched for.
+template<class Config, class Next>
+DecodeStatus decodeFrame(Next &next, FrameType<Config> &frame, const PreambleMeasure &preamble) {
+    auto threshold = sliceThreshold<Config>(preamble.level);
+    unsigned bitLength = Config::LENGTH_OF_ONE_BIT;
+    auto readObject = [&](auto &object) {
+        for (size_t i = 0; i < sizeof(object); ++i)
+            if (!sliceByte<Config>(next, ((char *) &object)[i], threshold, bitLength)) return false;
+        return true;
+    };
+    frame.snrDb = preamble.snrDb;
+    unsigned char rateStream, headerCrc;
+    if (!readObject(frame.len) || !readObject(frame.seq) || !readObject(rateStream) || !readObject(headerCrc))
+        return DecodeStatus::Aborted;
+    frame.setRateStream(rateStream);
+    // A damaged header, too long or an unknown rate! There must be some errors.
+    if (headerCrc != frame.headerCrc() || frame.len > Config::MAX_LENGTH_BODY ||
+        !Config::isPayloadBitLength(frame.bitLength))
+        return DecodeStatus::DiscardLength;
+    bitLength = frame.bitLength;
+    for (int i = 0; i < frame.len; ++i)
+        if (!sliceByte<Config>(next, frame.body[i], threshold, bitLength)) return DecodeStatus::Aborted;
+    unsigned int crcRead;
+    if (!readObject(crcRead)) return DecodeStatus::Aborted;
+    return crcRead == frame.crc() ? DecodeStatus::Delivered : DecodeStatus::DiscardCRC;
+}
+
+// Counts a decoded candidate with the len and seq it was read with; the caller hands Delivered frames on
+inline void countDecode(DecodeStatus status, int len, int seq, LinkStats *stats) {
+    switch (status) {
+        case DecodeStatus::Delivered:
+            TRACE(trace::Event::FrameDelivered, len, seq);
+            LinkStats::add(stats->framesDelivered);
+            break;
+        case DecodeStatus::DiscardLength:
+            TRACE(trace::Event::DiscardLength, len, seq);
+            LinkStats::add(stats->lengthDiscards);
+            break;
+        case DecodeStatus::DiscardCRC:
+            TRACE(trace::Event::DiscardCRC, len, seq);
+            LinkStats::add(stats->crcFailures);
+            break;
+        case DecodeStatus::Aborted:
+            break;
+    }
+}
+
+// Hands a delivered frame, or a damaged one whose header is sound, to the MAC. Without a frame (the
+// pool ran dry) or with the queue full the MAC has fallen far behind; the frame is dropped and
+// counted, and the ARQ sends it again. Its decode time goes into the latency stats either way.
+template<class Config>
+void deliverFrame(FrameQueue<Config> *output, FrameHandle<Config> &frame, int len, int seq, LinkStats *stats) {
+    if (frame) stats->latency.decode.record(frame->decodedMicros - frame->detectedMicros);
+    if (frame && output->push(frame)) return;
+    TRACE(trace::Event::FrameDropped, len, seq, (int32_t) output->framePool().available());
+    LinkStats::add(stats->framesDropped);
+}
+
+/* Single-threaded receiver: preamble search and decoding one after the other
+ *
+ * ReceivePipeline (pipeline.h) does the same work on several threads; this one is kept as the
+ * reference and for the tools. Both DC-block their input and slice every frame relative to the
+ * level of its preamble.
+ */
+template<class Config>
+class Reader : public Thread {
+public:
+    using Frame = FrameType<Config>;
+
+    Reader() = delete;
+
+    Reader(const Reader &) = delete;
+
+    Reader(const Reader &&) = delete;
+
+    explicit Reader(SampleRing *bufferIn, FrameQueue<Config> *bufferOut, LinkStats *statsPtr)
+            : Thread("Reader"), input(bufferIn), output(bufferOut), stats(statsPtr) {
+        fprintf(stderr, "    Reader Thread Start\n");
+    }
+
+    ~Reader() override { this->signalThreadShouldExit(); }
+
+    // With Config::BAND_SPLIT, which node's carrier to receive from now on; Node1's until told otherwise
+    void listenTo(bool senderIsNode1) { peer.store(senderIsNode1, std::memory_order_relaxed); }
+
+    // Slices with the level of the last preamble
+    char readByte() {
+        char byte = 0;
+        auto from = source();
+        sliceByte<Config>(from, byte, sliceThreshold<Config>(preamble.level));
+        return byte;
+    }
+
+    void waitForPreamble() {
+        auto sync = std::deque<float>(Config::PREAMBLE_SAMPLES, 0);
+        for (float sample; next(sample);) {
+            sync.pop_front();
+            sync.push_back(sample);
+            if (matchPreamble<Config>([&sync](unsigned i) { return sync[i]; }, preamble))
+                return;
+        }
+    }
+
+    void run() override {
+        assert(input != nullptr);
+        assert(output != nullptr);
+        trace::nameThread("Reader");
+        while (!threadShouldExit()) {
+            // wait for PREAMBLE
+            waitForPreamble();
+            if (threadShouldExit()) break;
+            TRACE(trace::Event::PreambleDetected, (int32_t) (preamble.level * 1e6f), (int32_t) (preamble.snrDb * 10));
+            LinkStats::add(stats->preamblesDetected);
+            LinkStats::set(stats->preambleLevelMicro, (int64_t) (preamble.level * 1e6f));
+            stats->latency.detect.record(Config::samplesToMicros(input->size()));
+            auto detectedMicros = LatencyStats::now();
+            // demodulated straight into a pooled frame, or into spare to stay in step if none is left
+            auto frame = output->framePool().acquire();
+            auto &target = frame ? *frame : spare;
+            target.receivedAt = position;
+            auto from = source();
+            auto status = decodeFrame<Config>(from, target, preamble);
+            target.detectedMicros = detectedMicros;
+            target.decodedMicros = LatencyStats::now();
+            if (status == DecodeStatus::DiscardCRC) target.damaged = true;
+            if (status == DecodeStatus::Delivered || status == DecodeStatus::DiscardCRC)
+                deliverFrame(output, frame, target.len, target.seq, stats);
+            countDecode(status, target.len, target.seq, stats);
+        }
+    }
+
+private:
+    // Pops one input sample, waiting for it; false once the thread should exit
+    bool next(float &sample) {
+        if constexpr (Config::BAND_SPLIT) {
+            auto senderIsNode1 = peer.load(std::memory_order_relaxed);
+            if (demodulator.tunedTo() != senderIsNode1) demodulator.tune(senderIsNode1);
+        }
+        while (!threadShouldExit())
+            if (input->pop(sample)) {
+                if constexpr (Config::BAND_SPLIT) sample = demodulator.processSample(sample);
+                sample = dcBlocker.processSample(sample);
+                ++position;
+                return true;
+            }
+        return false;
+    }
+
+    // next() as a callable for sliceByte() and decodeFrame()
+    auto source() {
+        return [this](float &sample) { return next(sample); };
+    }
+
+    SampleRing *input{nullptr};
+    uint64_t position{0}; // input samples taken so far
+    dsp::DcBlocker dcBlocker{Config::DC_BLOCKER_POLE};
+    BandDemodulator<Config> demodulator;
+    std::atomic<bool> peer{true}; // whose carrier, see listenTo()
+    PreambleMeasure preamble; // the last one
+    FrameQueue<Config> *output{nullptr};
+    Frame spare;
+    LinkStats *stats;
+};
+
+#endif//READER_H
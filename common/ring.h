@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/* Bounded single-producer single-consumer queue
+ *
+ * push() and pop() never block and never allocate; exactly one thread may push and one (other)
+ * thread may pop. N must be a power of two.
+ */
+template<class T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    SpscRing(const SpscRing &) = delete;
+
+    // Producer only: returns false if the ring is full
+    bool push(const T &item) {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) return false;
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only: returns false if the ring is empty
+    bool pop(T &item) {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer only: pushes as many of the n items as fit, returns how many did
+    size_t push(const T *src, size_t n) {
+        auto h = head.load(std::memory_order_relaxed);
+        n = std::min(n, N - (size_t) (h - tail.load(std::memory_order_acquire)));
+        for (size_t i = 0; i < n; ++i) items[(h + i) & (N - 1)] = src[i];
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer only: pops up to n items, returns how many it got
+    size_t pop(T *dst, size_t n) {
+        auto t = tail.load(std::memory_order_relaxed);
+        n = std::min(n, (size_t) (head.load(std::memory_order_acquire) - t));
+        for (size_t i = 0; i < n; ++i) dst[i] = items[(t + i) & (N - 1)];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    [[nodiscard]] size_t size() const {
+        auto t = tail.load(std::memory_order_acquire);
+        return head.load(std::memory_order_acquire) - t;
+    }
+
+    [[nodiscard]] bool empty() const { return size() == 0; }
+
+    [[nodiscard]] static constexpr size_t capacity() { return N; }
+
+private:
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::unique_ptr<T[]> items{new T[N]};
+};
+
+// Audio samples between the audio callback and the PHY threads, ~21s at 48kHz
+using SampleRing = SpscRing<float, 1 << 20>;
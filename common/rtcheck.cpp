@@ -0,0 +1,124 @@
+#include "rtcheck.h"
+
+#if PROJECT2_RT_CHECK
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+
+namespace rtcheck {
+
+namespace {
+thread_local int depth = 0; // trivially initialised, so reading it never allocates
+std::atomic<uint64_t> allocations{0}, locks{0}, scopes{0};
+
+void flagAllocation() {
+    if (depth > 0) allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void *allocate(std::size_t size) {
+    flagAllocation();
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void *allocateAligned(std::size_t size, std::align_val_t alignment) {
+    flagAllocation();
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, std::max(sizeof(void *), (std::size_t) alignment), size ? size : 1) != 0)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void release(void *ptr) {
+    if (ptr == nullptr) return;
+    flagAllocation();
+    std::free(ptr);
+}
+
+void flagLock() {
+    if (depth > 0) locks.fetch_add(1, std::memory_order_relaxed);
+}
+}// namespace
+
+RealtimeScope::RealtimeScope() {
+    ++depth;
+    scopes.fetch_add(1, std::memory_order_relaxed);
+}
+
+RealtimeScope::~RealtimeScope() { --depth; }
+
+Violations violations() {
+    return {allocations.load(std::memory_order_relaxed), locks.load(std::memory_order_relaxed),
+            scopes.load(std::memory_order_relaxed)};
+}
+
+void reset() {
+    allocations = 0;
+    locks = 0;
+    scopes = 0;
+}
+
+}// namespace rtcheck
+
+void *operator new(std::size_t size) { return rtcheck::allocate(size); }
+
+void *operator new[](std::size_t size) { return rtcheck::allocate(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    try { return rtcheck::allocate(size); } catch (...) { return nullptr; }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    try { return rtcheck::allocate(size); } catch (...) { return nullptr; }
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) { return rtcheck::allocateAligned(size, alignment); }
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return rtcheck::allocateAligned(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { rtcheck::release(ptr); }
+
+void operator delete[](void *ptr) noexcept { rtcheck::release(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { rtcheck::release(ptr); }
+
+void operator delete[](void *ptr, std::size_t) noexcept { rtcheck::release(ptr); }
+
+void operator delete(void *ptr, std::align_val_t) noexcept { rtcheck::release(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t) noexcept { rtcheck::release(ptr); }
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { rtcheck::release(ptr); }
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { rtcheck::release(ptr); }
+
+#if defined(__linux__)
+namespace {
+using MutexLock = int (*)(pthread_mutex_t *);
+// libc's own, looked up by whichever thread locks first; they all find the same one. Constant
+// initialised, so it is null even for locks taken before static initialisation
+std::atomic<MutexLock> realMutexLock{nullptr};
+}// namespace
+
+// Interposes the libc symbol, which CriticalSection and std::mutex end up in
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    auto real = realMutexLock.load(std::memory_order_acquire);
+    if (real == nullptr) {
+        real = (MutexLock) dlsym(RTLD_NEXT, "pthread_mutex_lock");
+        realMutexLock.store(real, std::memory_order_release);
+    }
+    rtcheck::flagLock();
+    return real(mutex);
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#ifndef PROJECT2_RT_CHECK
+#define PROJECT2_RT_CHECK 0
+#endif
+
+/* Real-time safety check for the audio callback
+ *
+ * Code that must not block marks itself with a RealtimeScope. Built with PROJECT2_RT_CHECK=1,
+ * every operator new/delete and every pthread mutex lock made by a thread inside such a scope is
+ * counted (lock interposition needs a Linux build). Otherwise the scope is empty and costs nothing.
+ */
+
+namespace rtcheck {
+
+struct Violations {
+    uint64_t allocations = 0;   // operator new and delete calls
+    uint64_t locks = 0;         // pthread_mutex_lock calls
+    uint64_t scopes = 0;        // RealtimeScopes entered
+
+    [[nodiscard]] bool clean() const { return allocations == 0 && locks == 0; }
+};
+
+#if PROJECT2_RT_CHECK
+
+class RealtimeScope {
+public:
+    RealtimeScope();
+
+    ~RealtimeScope();
+
+    RealtimeScope(const RealtimeScope &) = delete;
+};
+
+Violations violations();
+
+void reset();
+
+#else
+
+class RealtimeScope {
+public:
+    RealtimeScope() {} // NOLINT: user-provided, so an unused scope does not warn
+
+    RealtimeScope(const RealtimeScope &) = delete;
+};
+
+inline Violations violations() { return {}; }
+
+inline void reset() {}
+
+#endif
+
+constexpr bool enabled = PROJECT2_RT_CHECK;
+
+// Prints the counters; returns false if anything was flagged
+inline bool report(FILE *out) {
+    auto found = violations();
+    if (enabled)
+        fprintf(out, "rtcheck: %llu callbacks, %llu allocations, %llu locks\n", (unsigned long long) found.scopes,
+                (unsigned long long) found.allocations, (unsigned long long) found.locks);
+    return found.clean();
+}
+
+}// namespace rtcheck
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "ring.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// What the audio thread reports back for every transmission it played
+struct TransmissionReport {
+    uint64_t id = 0;
+    uint64_t requested = 0; // the sample it was scheduled for, ASAP if none
+    uint64_t queued = 0;    // now() when it was scheduled
+    uint64_t start = 0;     // the sample its first sample was played at
+    uint64_t end = 0;       // one past its last sample
+
+    // Samples it started after the requested one
+    [[nodiscard]] uint64_t lateness() const { return start > requested ? start - requested : 0; }
+
+    // Samples it waited for the audio callback after it was scheduled, whatever held it back
+    [[nodiscard]] uint64_t waited() const { return start > queued ? start - queued : 0; }
+};
+
+/* Sample-accurate output of Part3 - Part5
+ *
+ * The audio callback keeps a sample clock: sample t is the t-th sample played since the link was
+ * created. A transmission is queued with the sample it has to start at (or ASAP), and render()
+ * mixes it in at exactly that sample, or as soon as possible if that sample has already been
+ * played. Transmissions never overlap, so one that is due while another is on air waits for it.
+ * Once the last sample is played, a TransmissionReport with the real start and end goes back to
+ * whoever polls popReport(); reports nobody collects are dropped once the ring is full.
+ *
+ * schedule() and popReport() may be called by one thread at a time (the Writer orders its
+ * senders); render() only by the audio thread. Nothing here blocks or allocates.
+ */
+class OutputScheduler {
+public:
+    static constexpr uint64_t ASAP = UINT64_MAX;
+
+    struct Rendered {
+        size_t transmitted = 0; // samples of this block that carried a transmission
+        unsigned late = 0;      // transmissions started after the requested sample
+    };
+
+    OutputScheduler() = default;
+
+    OutputScheduler(const OutputScheduler &) = delete;
+
+    // Queues n samples to start at sample at; returns false, queuing nothing, if there is no room yet
+    bool schedule(const float *data, size_t n, uint64_t at, uint64_t &id) {
+        if (n == 0 || requests.size() == requests.capacity() ||
+            samples.capacity() - samples.size() < n)
+            return false;
+        samples.push(data, n);
+        id = ++lastId;
+        requests.push({id, at, now(), (uint32_t) n});
+        return true;
+    }
+
+    bool popReport(TransmissionReport &report) { return reports.pop(report); }
+
+    // The first sample of the next block the audio callback renders
+    [[nodiscard]] uint64_t now() const { return clock.load(std::memory_order_acquire); }
+
+    // Samples queued and not played yet
+    [[nodiscard]] size_t backlog() const { return samples.size(); }
+
+    // Audio thread only: fills out with the next n samples of the clock, silence where nothing is due
+    Rendered render(float *out, size_t n) {
+        Rendered ret;
+        std::fill(out, out + n, 0.0f);
+        auto blockStart = clock.load(std::memory_order_relaxed);
+        size_t pos = 0;
+        while (pos < n) {
+            if (!hasCurrent) {
+                if (!requests.pop(current)) break;
+                hasCurrent = true;
+                started = false;
+            }
+            if (!started) {
+                if (current.at != ASAP && current.at > blockStart + pos) {
+                    if (current.at >= blockStart + n) break; // due in a later block
+                    pos = (size_t) (current.at - blockStart);
+                }
+                started = true;
+                startedAt = blockStart + pos;
+                remaining = current.length;
+                if (current.at != ASAP && startedAt > current.at) ++ret.late;
+            }
+            auto take = std::min<size_t>(remaining, n - pos);
+            samples.pop(out + pos, take);
+            pos += take;
+            remaining -= (uint32_t) take;
+            ret.transmitted += take;
+            if (remaining == 0) {
+                reports.push({current.id, current.at, current.queued, startedAt, blockStart + pos});
+                hasCurrent = false;
+            }
+        }
+        clock.store(blockStart + n, std::memory_order_release);
+        return ret;
+    }
+
+private:
+    struct Request {
+        uint64_t id;
+        uint64_t at;
+        uint64_t queued;
+        uint32_t length;
+    };
+
+    SampleRing samples;
+    SpscRing<Request, 1024> requests;
+    SpscRing<TransmissionReport, 1024> reports;
+    std::atomic<uint64_t> clock{0};
+    uint64_t lastId{0}; // producer side
+
+    // audio thread side
+    Request current{};
+    bool hasCurrent{false};
+    bool started{false};
+    uint64_t startedAt{0};
+    uint32_t remaining{0};
+};
@@ -0,0 +1,586 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include "frame.h"
+#include "handshake.h"
+#include "mac.h"
+#include "pool.h"
+#include "rate.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/* Reliable, ordered byte stream to the other node
+ *
+ * write() queues bytes and read() takes what has arrived, like a TCP socket: the stream has no
+ * message boundaries and runs for as long as the socket is open, so an application can keep
+ * writing while earlier bytes are still on air. Every call comes in three flavours:
+ *   tryWrite / tryRead    never block, return how many bytes they took or gave
+ *   write / read          block until everything is queued / at least one byte arrived
+ *   writeAsync / readAsync return a future, ready once the bytes are acknowledged / have arrived
+ * Calls return early (0, false or what is left) once the socket closed, after close() or a link error.
+ * One thread may write while another reads; blocking and async reads should not be mixed.
+ */
+class LinkSocket {
+public:
+    virtual ~LinkSocket() = default;
+
+    virtual size_t tryWrite(const char *data, size_t size) = 0;
+
+    virtual size_t write(const char *data, size_t size) = 0;
+
+    // Queues all of data, however much is queued already
+    virtual std::future<bool> writeAsync(std::string data) = 0;
+
+    virtual size_t tryRead(char *data, size_t size) = 0;
+
+    virtual size_t read(char *data, size_t size) = 0;
+
+    // Ready once size bytes arrived, with fewer if the socket closed before
+    virtual std::future<std::string> readAsync(size_t size) = 0;
+
+    // Waits until everything written so far is acknowledged; false on timeout or a closed socket
+    virtual bool flush(double timeoutSeconds) = 0;
+
+    // Stops the stream; bytes not sent yet are dropped, so flush() first
+    virtual void close() = 0;
+
+    [[nodiscard]] virtual bool isOpen() const = 0;
+};
+
+/* Config::STREAMS byte streams over one sliding window, on their own worker thread
+ *
+ * Data frames are numbered without end: frame i goes out with SEQ i % 127 + 1, positive from Node1
+ * and negative from Node2, and at most Config::SLIDING_WINDOW_SIZE of them are unacknowledged at a
+ * time, so an ACK always names one frame. Resend timeouts, NACKs and fast retransmission and the
+ * payload rate work as in Mac.
+ *
+ * STREAM in the header names the stream, and BODY starts with the position of its first byte in
+ * that stream (modulo 2^16), so every stream is reassembled on its own and a lost frame of one
+ * stream never holds back another. Whenever the window has room, deficit round robin picks the
+ * stream of the next frame: each visit grants a stream its weight in full frames.
+ *
+ * Flow control is by credit: a sender may send a stream up to the limit the receiver granted,
+ * Config::STREAM_BUFFER bytes beyond what the receiving application has read. The receiver grants
+ * more in a control frame (SEQ 0) once its application read a quarter of that, and a sender that
+ * is out of credit asks again every Config::CREDIT_PROBE_INTERVAL, in case a grant got lost.
+ *
+ * The window and the longest BODY are what the handshake had agreed on when the mux started, the
+ * window once for every lane; ACKs and NACKs go back on the lane of their frame as in Mac. Its
+ * SYN and SYN-ACK are control frames too and are answered here while the mux runs.
+ */
+template<class Config>
+class StreamMux : private Thread {
+public:
+    using Frame = FrameType<Config>;
+    using LENType = typename Config::LENType;
+    using SEQType = typename Config::SEQType;
+
+    StreamMux(const StreamMux &) = delete;
+
+    explicit StreamMux(FrameQueue<Config> *bufferIn, Writer<Config> *writerPtr, LinkStats *statsPtr,
+                       Handshake<Config> *handshakePtr, bool node1, int resends) :
+            Thread("Stream Mux"), input(bufferIn), writer(writerPtr), stats(statsPtr), handshake(handshakePtr),
+            agreed(handshakePtr->agreed()), maxChunk(agreed.maxBody - LENGTH_POSITION), rate(statsPtr),
+            isNode1(node1), resendTimes(resends) {
+        startThread();
+    }
+
+    ~StreamMux() override {
+        stopThread(1000);
+        std::lock_guard<std::mutex> guard(lock);
+        alive = false;
+        for (unsigned id = 0; id < Config::STREAMS; ++id) shut(streams[id]);
+    }
+
+    // Claims stream id for a socket; false if it is taken, beyond the streams the handshake agreed
+    // on, or the link broke
+    bool open(unsigned id, unsigned weight) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!alive || id >= agreed.streams || streams[id].open) return false;
+        streams[id].open = true;
+        streams[id].weight = std::max(weight, 1u);
+        return true;
+    }
+
+    void close(unsigned id) {
+        std::lock_guard<std::mutex> guard(lock);
+        streams[id].sendBuffer.clear();
+        shut(streams[id]);
+    }
+
+    [[nodiscard]] bool isOpen(unsigned id) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return streams[id].open;
+    }
+
+    [[nodiscard]] bool isAlive() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return alive;
+    }
+
+    size_t tryWrite(unsigned id, const char *data, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto &stream = streams[id];
+        if (!stream.open) return 0;
+        size = std::min(size, SEND_BUFFER - std::min(SEND_BUFFER, stream.sendBuffer.size()));
+        queue(stream, data, size);
+        return size;
+    }
+
+    size_t write(unsigned id, const char *data, size_t size) {
+        auto &stream = streams[id];
+        size_t done = 0;
+        while (done < size) {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return !stream.open || stream.sendBuffer.size() < SEND_BUFFER; });
+            if (!stream.open) break;
+            auto n = std::min(size - done, SEND_BUFFER - stream.sendBuffer.size());
+            queue(stream, data + done, n);
+            done += n;
+        }
+        return done;
+    }
+
+    std::future<bool> writeAsync(unsigned id, const std::string &data) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto &stream = streams[id];
+        std::promise<bool> promise;
+        auto ret = promise.get_future();
+        if (!stream.open) {
+            promise.set_value(false);
+            return ret;
+        }
+        queue(stream, data.data(), data.size());
+        stream.pendingWrites.push_back({stream.written, std::move(promise)});
+        return ret;
+    }
+
+    size_t tryRead(unsigned id, char *data, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        return take(streams[id], data, size);
+    }
+
+    size_t read(unsigned id, char *data, size_t size) {
+        auto &stream = streams[id];
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return !stream.open || !stream.receiveBuffer.empty(); });
+        return take(stream, data, size);
+    }
+
+    std::future<std::string> readAsync(unsigned id, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto &stream = streams[id];
+        stream.pendingReads.push_back({size, {}});
+        auto ret = stream.pendingReads.back().promise.get_future();
+        completeReads(stream);
+        return ret;
+    }
+
+    bool flush(unsigned id, double timeoutSeconds) {
+        auto &stream = streams[id];
+        std::unique_lock<std::mutex> guard(lock);
+        return changed.wait_for(guard, std::chrono::duration<double>(timeoutSeconds),
+                                [&] { return !stream.open || stream.acknowledged == stream.written; }) &&
+               stream.open;
+    }
+
+private:
+    static constexpr unsigned SEQ_SPACE = 127;
+    static constexpr unsigned WINDOW = Config::SLIDING_WINDOW_SIZE;
+    static constexpr size_t SEND_BUFFER = 64 * 1024;        // per stream, for write() and tryWrite()
+    static constexpr unsigned LENGTH_POSITION = sizeof(uint16_t);
+    static constexpr char CREDIT = 'C', PROBE = 'P';
+    static constexpr LENType CREDIT_LENGTH = 6;  // CREDIT, sending node, uint32_t limit
+    static constexpr LENType PROBE_LENGTH = 2;   // PROBE, sending node
+    static_assert(2 * WINDOW * MAX_LANES <= SEQ_SPACE, "SEQ would wrap into the window");
+    static_assert(Config::STREAM_BUFFER < 32 * 1024, "positions are told apart modulo 2^16");
+
+    struct PendingWrite {
+        uint64_t end; // Stream::written the write is done at
+        std::promise<bool> promise;
+    };
+
+    struct PendingRead {
+        size_t size;
+        std::promise<std::string> promise;
+    };
+
+    struct Stream {
+        // Shared with the application, under lock
+        bool open{false};
+        unsigned weight{1};
+        std::deque<char> sendBuffer, receiveBuffer;
+        uint64_t written{0}, acknowledged{0}, consumed{0};
+        std::deque<PendingWrite> pendingWrites;
+        std::deque<PendingRead> pendingReads;
+        // Worker thread only
+        uint64_t framed{0};                   // bytes cut into frames
+        uint64_t peerLimit{Config::STREAM_BUFFER}; // the peer's credit: bytes we may frame in total
+        uint64_t delivered{0};                // bytes reassembled in order
+        uint64_t granted{Config::STREAM_BUFFER};   // the credit we gave the peer
+        std::map<uint64_t, FrameHandle<Config>> early; // received ahead of delivered, by position
+        size_t deficit{0};
+        MyTimer stalled;                      // since we last asked for credit
+    };
+
+    struct Outgoing {
+        Frame frame;
+        FrameWaitingInfo info;
+    };
+
+    void run() override {
+        trace::nameThread("Stream Mux");
+        rate.reset();
+        rate.allow(agreed.rates);
+        writer->useLanes(agreed.lanes);
+        while (!threadShouldExit()) {
+            for (TransmissionReport report; writer->popReport(report);)
+                for (auto &outgoing: window)
+                    if (outgoing.info.transmission == report.id) {
+                        outgoing.info.timer.restart();
+                        outgoing.info.aired = true;
+                    }
+            bool busy = false;
+            for (FrameHandle<Config> frame; input->pop(frame);) {
+                busy = true;
+                bool mine = isNode1 == (frame->seq > 0);
+                if (frame->damaged) {
+                    if (frame->seq != 0 && frame->len != 0 && !mine) nack(frame->seq, frame->lane);
+                } else if (frame->seq == 0) control(*frame);
+                else if (frame->len != 0 && !mine) receive(frame);
+                else if (frame->isNack() && mine) fastResend(distance(frame->seq, base), true);
+                else if (frame->len == 0 && mine) acknowledge(*frame);
+            }
+            if (!resend()) {
+                std::lock_guard<std::mutex> guard(lock);
+                alive = false;
+                for (auto &stream: streams) shut(stream);
+                return;
+            }
+            busy |= sendNew();
+            askCredit();
+            grantCredit();
+            if (!busy) Thread::sleep(1);
+        }
+    }
+
+    // Offset of a SEQ from the frame numbered base, modulo the SEQ space
+    static unsigned distance(SEQType seq, uint64_t base) {
+        return (unsigned) ((abs(seq) - 1 + SEQ_SPACE - base % SEQ_SPACE) % SEQ_SPACE);
+    }
+
+    // The full position whose low bits are wire, nearest to reference
+    static uint64_t unwrap(uint64_t reference, uint16_t wire) {
+        return reference + (int16_t) (uint16_t) (wire - (uint16_t) reference);
+    }
+
+    void control(const Frame &frame) {
+        if (handshake->handle(isNode1, frame)) return;
+        if (frame.stream >= Config::STREAMS || frame.len < PROBE_LENGTH || frame.body[1] == node()) return;
+        auto &stream = streams[frame.stream];
+        if (frame.body[0] == CREDIT && frame.len == CREDIT_LENGTH) {
+            uint32_t limit;
+            memcpy(&limit, frame.body + 2, sizeof(limit));
+            stream.peerLimit = std::max(stream.peerLimit, stream.peerLimit + (int32_t) (limit - (uint32_t) stream.peerLimit));
+        } else if (frame.body[0] == PROBE && frame.len == PROBE_LENGTH) {
+            sendCredit(frame.stream);
+        }
+    }
+
+    void receive(FrameHandle<Config> &frame) {
+        TRACE(trace::Event::FrameReceived, frame->seq);
+        LinkStats::add(stats->framesReceived);
+        rate.observeSnr(frame->snrDb);
+        if (frame->stream >= Config::STREAMS || frame->len <= LENGTH_POSITION) return;
+        auto &stream = streams[frame->stream];
+        uint16_t wire;
+        memcpy(&wire, frame->body, sizeof(wire));
+        auto position = unwrap(stream.delivered, wire);
+        size_t len = frame->len - LENGTH_POSITION;
+        // beyond the credit we gave: the peer cannot have sent it, so it is garbage
+        if (position + len > stream.granted) return;
+        writer->send(Frame(0, frame->seq, nullptr), OutputScheduler::ASAP, frame->lane);
+        stats->latency.ackTurnaround.record(LatencyStats::elapsed(frame->deliveredMicros));
+        TRACE(trace::Event::AckSent, frame->seq);
+        LinkStats::add(stats->acksSent);
+        if (position + len <= stream.delivered) return; // a repeat whose ACK got lost
+        // kept in its pooled buffer until everything in front of it arrived
+        stream.early[position] = std::move(frame);
+        std::string ready;
+        for (auto it = stream.early.begin(); it != stream.early.end() && it->first <= stream.delivered;
+             it = stream.early.erase(it)) {
+            auto skip = stream.delivered - it->first;
+            size_t size = it->second->len - LENGTH_POSITION;
+            if (skip >= size) continue;
+            ready.append(it->second->body + LENGTH_POSITION + skip, size - skip);
+            stream.delivered += size - skip;
+        }
+        if (ready.empty()) return;
+        std::lock_guard<std::mutex> guard(lock);
+        stream.receiveBuffer.insert(stream.receiveBuffer.end(), ready.begin(), ready.end());
+        completeReads(stream);
+        changed.notify_all();
+    }
+
+    void acknowledge(const Frame &frame) {
+        auto offset = distance(frame.seq, base);
+        if (offset >= window.size() || window[offset].info.receiveACK) return;
+        window[offset].info.receiveACK = true;
+        rate.observeSnr(frame.snrDb);
+        rate.report(window[offset].frame.bitLength, true);
+        TRACE(trace::Event::AckReceived, frame.seq, window[offset].info.resendTimes);
+        LinkStats::add(stats->acksReceived);
+        // frames stay in order on a lane, so an older one still waiting on it was lost
+        for (unsigned older = 0; older < offset; ++older)
+            if (writer->laneOf(window[older].info.transmission) == frame.lane) fastResend(older, false);
+        if (!window.front().info.receiveACK) return;
+        std::lock_guard<std::mutex> guard(lock);
+        // frames of one stream go out in order, so each stream is acknowledged without gaps
+        for (; !window.empty() && window.front().info.receiveACK; ++base) {
+            auto &stream = streams[window.front().frame.stream];
+            stream.acknowledged += window.front().frame.len - LENGTH_POSITION;
+            while (!stream.pendingWrites.empty() && stream.pendingWrites.front().end <= stream.acknowledged) {
+                stream.pendingWrites.front().promise.set_value(true);
+                stream.pendingWrites.pop_front();
+            }
+            window.pop_front();
+        }
+        changed.notify_all();
+    }
+
+    // Sends the frames whose ACK timed out again; false on a link error
+    bool resend() {
+        auto timeout = isNode1 ? Config::SLIDING_WINDOW_TIMEOUT_NODE1 : Config::SLIDING_WINDOW_TIMEOUT_NODE2;
+        for (auto &outgoing: window) {
+            auto &info = outgoing.info;
+            if (info.receiveACK || info.timer.duration() < timeout) continue;
+            if (info.resendTimes == 0) {
+                TRACE(trace::Event::LinkError, outgoing.frame.seq);
+                LinkStats::add(stats->linkErrors);
+                fprintf(stderr, "Link error detected! frame seq = %d resend too many times...\n", outgoing.frame.seq);
+                return false;
+            }
+            sendAgain(writer, rate, outgoing.frame, info);
+            TRACE(trace::Event::FrameResent, outgoing.frame.seq, info.resendTimes);
+            LinkStats::add(stats->framesResent);
+        }
+        return true;
+    }
+
+    // Resends the frame at offset in the window before its timeout if fastRetransmit says so
+    void fastResend(unsigned offset, bool nack) {
+        if (offset >= window.size() || !fastRetransmit<Config>(window[offset].info, nack)) return;
+        auto &outgoing = window[offset];
+        sendAgain(writer, rate, outgoing.frame, outgoing.info);
+        TRACE(trace::Event::FastRetransmit, outgoing.frame.seq, outgoing.info.resendTimes, nack);
+        LinkStats::add(stats->fastRetransmits);
+    }
+
+    // Asks the peer for its frame seq again, whose header arrived but not its BODY on lane
+    void nack(SEQType seq, unsigned lane) {
+        writer->send(makeNack<Config>(seq), OutputScheduler::ASAP, lane);
+        TRACE(trace::Event::NackSent, seq);
+        LinkStats::add(stats->nacksSent);
+    }
+
+    // Fills the window with frames of the streams deficit round robin picks
+    bool sendNew() {
+        bool sent = false;
+        while (window.size() < agreed.window * agreed.lanes) {
+            Outgoing outgoing;
+            auto &frame = outgoing.frame;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                size_t len = 0;
+                for (unsigned visits = 0; visits <= Config::STREAMS && len == 0; ++visits) {
+                    auto &stream = streams[turn];
+                    len = sendable(turn);
+                    if (len != 0 && fresh) stream.deficit += stream.weight * maxChunk;
+                    fresh = len == 0 || stream.deficit < len;
+                    if (fresh) {
+                        if (len == 0) stream.deficit = 0;
+                        len = 0;
+                        turn = (turn + 1) % Config::STREAMS;
+                    }
+                }
+                if (len == 0) break;
+                auto &stream = streams[turn];
+                stream.deficit -= len;
+                auto position = (uint16_t) stream.framed;
+                memcpy(frame.body, &position, sizeof(position));
+                std::copy(stream.sendBuffer.begin(), stream.sendBuffer.begin() + (ptrdiff_t) len,
+                          frame.body + LENGTH_POSITION);
+                stream.sendBuffer.erase(stream.sendBuffer.begin(), stream.sendBuffer.begin() + (ptrdiff_t) len);
+                stream.framed += len;
+                frame.len = (LENType) (len + LENGTH_POSITION);
+                frame.stream = (unsigned char) turn;
+                changed.notify_all();
+            }
+            auto number = base + window.size();
+            frame.seq = (SEQType) ((signed) (number % SEQ_SPACE + 1) * (isNode1 ? 1 : -1));
+            frame.bitLength = (unsigned char) rate.pick();
+            outgoing.info.resendTimes = resendTimes;
+            outgoing.info.transmission = writer->send(frame);
+            TRACE(trace::Event::FrameSent, frame.seq);
+            LinkStats::add(stats->framesSent);
+            window.push_back(outgoing);
+            LinkStats::set(stats->windowInUse, (int64_t) window.size());
+            sent = true;
+        }
+        return sent;
+    }
+
+    // Bytes the next frame of stream id can carry, with lock held
+    size_t sendable(unsigned id) {
+        auto &stream = streams[id];
+        auto credit = stream.peerLimit - std::min(stream.peerLimit, stream.framed);
+        return std::min<size_t>({maxChunk, stream.sendBuffer.size(), credit});
+    }
+
+    // Asks the peer for credit on every stream that has been waiting for it too long
+    void askCredit() {
+        for (unsigned id = 0; id < Config::STREAMS; ++id) {
+            auto &stream = streams[id];
+            size_t waiting;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                waiting = stream.framed < stream.peerLimit ? 0 : stream.sendBuffer.size();
+            }
+            if (waiting == 0 || stream.stalled.duration() < Config::CREDIT_PROBE_INTERVAL) continue;
+            TRACE(trace::Event::CreditStalled, (int32_t) id, (int32_t) waiting);
+            LinkStats::add(stats->creditStalls);
+            char body[PROBE_LENGTH]{PROBE, node()};
+            Frame probe(PROBE_LENGTH, 0, body);
+            probe.stream = (unsigned char) id;
+            writer->send(probe);
+            stream.stalled.restart();
+        }
+    }
+
+    // Grants more credit on every stream whose application read a quarter of its buffer
+    void grantCredit() {
+        for (unsigned id = 0; id < Config::STREAMS; ++id) {
+            uint64_t consumed;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                consumed = streams[id].consumed;
+            }
+            if (consumed + Config::STREAM_BUFFER >= streams[id].granted + Config::STREAM_BUFFER / 4) sendCredit(id);
+        }
+    }
+
+    void sendCredit(unsigned id) {
+        auto &stream = streams[id];
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stream.granted = std::max(stream.granted, stream.consumed + Config::STREAM_BUFFER);
+        }
+        char body[CREDIT_LENGTH]{CREDIT, node()};
+        auto limit = (uint32_t) stream.granted;
+        memcpy(body + 2, &limit, sizeof(limit));
+        Frame credit(CREDIT_LENGTH, 0, body);
+        credit.stream = (unsigned char) id;
+        writer->send(credit);
+        TRACE(trace::Event::CreditGranted, (int32_t) id, (int32_t) (stream.granted - stream.delivered));
+        LinkStats::add(stats->creditsSent);
+    }
+
+    [[nodiscard]] char node() const { return isNode1 ? '1' : '2'; }
+
+    // The rest with lock held
+
+    void queue(Stream &stream, const char *data, size_t size) {
+        stream.sendBuffer.insert(stream.sendBuffer.end(), data, data + size);
+        stream.written += size;
+    }
+
+    size_t take(Stream &stream, char *data, size_t size) {
+        size = std::min(size, stream.receiveBuffer.size());
+        std::copy(stream.receiveBuffer.begin(), stream.receiveBuffer.begin() + (ptrdiff_t) size, data);
+        stream.receiveBuffer.erase(stream.receiveBuffer.begin(), stream.receiveBuffer.begin() + (ptrdiff_t) size);
+        stream.consumed += size;
+        return size;
+    }
+
+    void completeReads(Stream &stream) {
+        while (!stream.pendingReads.empty() &&
+               (!stream.open || stream.receiveBuffer.size() >= stream.pendingReads.front().size)) {
+            std::string data(std::min(stream.pendingReads.front().size, stream.receiveBuffer.size()), '\0');
+            take(stream, data.data(), data.size());
+            stream.pendingReads.front().promise.set_value(std::move(data));
+            stream.pendingReads.pop_front();
+        }
+    }
+
+    void shut(Stream &stream) {
+        stream.open = false;
+        completeReads(stream);
+        for (auto &pending: stream.pendingWrites) pending.promise.set_value(false);
+        stream.pendingWrites.clear();
+        changed.notify_all();
+    }
+
+    FrameQueue<Config> *input;
+    Writer<Config> *writer;
+    LinkStats *stats;
+    Handshake<Config> *handshake;
+    const Capabilities agreed; // when the mux started
+    const size_t maxChunk;     // stream bytes per frame
+    RateControl<Config> rate;
+    bool isNode1;
+    int resendTimes;
+
+    // Worker thread only
+    std::deque<Outgoing> window; // sent and not acknowledged in order yet, the first one is numbered base
+    uint64_t base{0};
+    unsigned turn{0};            // the stream deficit round robin visits
+    bool fresh{true};            // turn has not got its quantum for this visit yet
+
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    bool alive{true};
+    std::array<Stream, Config::STREAMS> streams;
+};
+
+// One stream of a StreamMux; the mux stops once its last socket is gone
+template<class Config>
+class MuxSocket final : public LinkSocket {
+public:
+    MuxSocket(std::shared_ptr<StreamMux<Config>> streamMux, unsigned streamId) : mux(std::move(streamMux)), id(streamId) {}
+
+    ~MuxSocket() override { close(); }
+
+    size_t tryWrite(const char *data, size_t size) override { return mux->tryWrite(id, data, size); }
+
+    size_t write(const char *data, size_t size) override { return mux->write(id, data, size); }
+
+    std::future<bool> writeAsync(std::string data) override { return mux->writeAsync(id, data); }
+
+    size_t tryRead(char *data, size_t size) override { return mux->tryRead(id, data, size); }
+
+    size_t read(char *data, size_t size) override { return mux->read(id, data, size); }
+
+    std::future<std::string> readAsync(size_t size) override { return mux->readAsync(id, size); }
+
+    bool flush(double timeoutSeconds) override { return mux->flush(id, timeoutSeconds); }
+
+    void close() override { mux->close(id); }
+
+    [[nodiscard]] bool isOpen() const override { return mux->isOpen(id); }
+
+private:
+    std::shared_ptr<StreamMux<Config>> mux;
+    unsigned id;
+};
+
+#endif//SOCKET_H
@@ -0,0 +1,142 @@
+#include "stats.h"
+#include <algorithm>
+#include <cstdio>
+
+LatencySummary LatencyHistogram::summary() const {
+    LatencySummary ret;
+    uint64_t total = 0;
+    for (unsigned b = 0; b < BUCKETS; ++b) total += ret.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+    ret.count = total;
+    ret.max = max.load(std::memory_order_relaxed);
+    if (total == 0) return ret;
+    ret.mean = sum.load(std::memory_order_relaxed) / total;
+    auto percentile = [&](uint64_t percent) {
+        uint64_t seen = 0;
+        for (unsigned b = 0; b < BUCKETS; ++b)
+            if ((seen += ret.buckets[b]) * 100 >= total * percent) return std::min((uint64_t(2) << b) - 1, ret.max);
+        return ret.max;
+    };
+    ret.p50 = percentile(50);
+    ret.p90 = percentile(90);
+    ret.p99 = percentile(99);
+    return ret;
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket: buckets) bucket.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+std::string LatencyStats::csv() const {
+    std::string ret = "stage,count,mean_us,p50_us,p90_us,p99_us,max_us";
+    for (unsigned b = 0; b < LatencySummary::BUCKETS; ++b) ret += ",lt" + std::to_string(uint64_t(2) << b) + "us";
+    ret += "\n";
+#define X(name, side) { \
+        auto summary = name.summary(); \
+        ret += #side "." #name "," + std::to_string(summary.count) + "," + std::to_string(summary.mean) + "," + \
+               std::to_string(summary.p50) + "," + std::to_string(summary.p90) + "," + std::to_string(summary.p99) + \
+               "," + std::to_string(summary.max); \
+        for (auto count: summary.buckets) ret += "," + std::to_string(count); \
+        ret += "\n"; \
+    }
+    LINK_LATENCY_STAGES(X)
+#undef X
+    return ret;
+}
+
+bool LatencyStats::save(const std::string &path) const {
+    auto out = fopen(path.c_str(), "w");
+    if (out == nullptr) return false;
+    fputs(csv().c_str(), out);
+    fclose(out);
+    return true;
+}
+
+void LatencyStats::reset() {
+#define X(name, side) name.reset();
+    LINK_LATENCY_STAGES(X)
+#undef X
+}
+
+std::string StatsSnapshot::csvHeader() {
+    std::string ret = "seconds";
+#define X(name, layer) ret += "," #layer "." #name;
+    LINK_STATS_COUNTERS(X)
+    LINK_STATS_GAUGES(X)
+#undef X
+    return ret + ",airtime";
+}
+
+std::string StatsSnapshot::csvRow() const {
+    std::string ret = std::to_string(seconds);
+#define X(name, layer) ret += "," + std::to_string(name);
+    LINK_STATS_COUNTERS(X)
+    LINK_STATS_GAUGES(X)
+#undef X
+    return ret + "," + std::to_string(airtime());
+}
+
+std::string StatsSnapshot::json() const {
+    std::string ret = "{\"seconds\":" + std::to_string(seconds);
+#define X(name, layer) ret += ",\"" #layer "." #name "\":" + std::to_string(name);
+    LINK_STATS_COUNTERS(X)
+    LINK_STATS_GAUGES(X)
+#undef X
+    return ret + ",\"airtime\":" + std::to_string(airtime()) + "}";
+}
+
+StatsSnapshot LinkStats::snapshot() const {
+    StatsSnapshot ret;
+#define X(name, layer) ret.name = name.load(std::memory_order_relaxed);
+    LINK_STATS_COUNTERS(X)
+    LINK_STATS_GAUGES(X)
+#undef X
+    auto since = std::chrono::steady_clock::duration(start.load(std::memory_order_relaxed));
+    ret.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch() - since).count();
+    return ret;
+}
+
+void LinkStats::reset() {
+#define X(name, layer) name.store(0, std::memory_order_relaxed);
+    LINK_STATS_COUNTERS(X)
+    LINK_STATS_GAUGES(X)
+#undef X
+    latency.reset();
+    start.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool StatsExporter::start(const LinkStats *source, const std::string &path, int intervalMs) {
+    if (running) return true;
+    out = fopen(path.c_str(), "w");
+    if (out == nullptr) return false;
+    stats = source;
+    json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (!json) fprintf(out, "%s\n", StatsSnapshot::csvHeader().c_str());
+    running = true;
+    worker = std::thread([this, intervalMs] {
+        auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(intervalMs);
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (std::chrono::steady_clock::now() < next) continue;
+            next += std::chrono::milliseconds(intervalMs);
+            dump();
+        }
+    });
+    return true;
+}
+
+void StatsExporter::stop() {
+    if (!running) return;
+    running = false;
+    worker.join();
+    dump();
+    fclose(out);
+    out = nullptr;
+}
+
+void StatsExporter::dump() {
+    auto snapshot = stats->snapshot();
+    fprintf(out, "%s\n", json ? snapshot.json().c_str() : snapshot.csvRow().c_str());
+    fflush(out);
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/* Per-layer link statistics
+ *
+ * Counters are relaxed atomics bumped by the Reader, the Writer, the MAC and the audio callback.
+ * snapshot() copies them into plain numbers; StatsExporter appends a snapshot to a CSV file
+ * (or JSON lines if the file name ends with ".json") at a fixed interval. Per-stage latency goes
+ * into histograms next to them (LatencyStats), which are saved once at the end.
+ */
+
+//  X(name, layer)
+#define LINK_STATS_COUNTERS(X) \
+    X(preamblesDetected, reader) \
+    X(lengthDiscards, reader) \
+    X(crcFailures, reader) \
+    X(framesDelivered, reader) \
+    X(candidateOverruns, reader) \
+    X(candidatesDropped, reader) \
+    X(duplicateFrames, reader) \
+    X(framesDropped, reader) \
+    X(framesQueued, writer) \
+    X(deferCount, writer) \
+    X(deferMicros, writer) \
+    X(framesSent, mac) \
+    X(framesResent, mac) \
+    X(framesReceived, mac) \
+    X(acksSent, mac) \
+    X(acksReceived, mac) \
+    X(nacksSent, mac) \
+    X(fastRetransmits, mac) \
+    X(linkErrors, mac) \
+    X(beaconsSent, mac) \
+    X(beaconsReceived, mac) \
+    X(creditsSent, mac) \
+    X(creditStalls, mac) \
+    X(handshakes, mac) \
+    X(samplesTransmitted, audio) \
+    X(samplesElapsed, audio) \
+    X(inputOverruns, audio) \
+    X(lateTransmissions, audio)
+
+//  X(name, layer)
+#define LINK_STATS_GAUGES(X) \
+    X(windowInUse, mac) \
+    X(slotsOwned, mac) \
+    X(payloadBitLength, mac) \
+    X(peerSnrDb, mac) \
+    X(outputBacklog, writer) \
+    X(preambleLevelMicro, reader) \
+    X(noiseFloorMicro, audio)
+
+/* Where the time of a frame goes, stage by stage, in microseconds
+ *
+ * Sender side, for the frames this node sends:
+ *   macQueue      transfer() was handed the data, until the MAC handed a frame of it to the Writer
+ *   carrierSense  listening before transmit
+ *   render        modulating it and queuing the samples
+ *   outputQueue   queued, until the audio callback took its first sample (frames sent ASAP only)
+ *   airtime       its first sample to its last
+ * Receiver side, for the frames the receiver hands to the MAC:
+ *   detect        the audio callback handed over the last sample of its preamble, until the
+ *                 detector found the preamble
+ *   decode        preamble found, until its CRC was checked; the rest of the frame arrives meanwhile
+ *   deliver       CRC checked, until the MAC took it from the queue
+ *   ackTurnaround the MAC took it, until the MAC handed its ACK to the Writer (in TDMA at its next turn)
+ */
+//  X(name, side)
+#define LINK_LATENCY_STAGES(X) \
+    X(macQueue, sender) \
+    X(carrierSense, sender) \
+    X(render, sender) \
+    X(outputQueue, sender) \
+    X(airtime, sender) \
+    X(detect, receiver) \
+    X(decode, receiver) \
+    X(deliver, receiver) \
+    X(ackTurnaround, receiver)
+
+struct LatencySummary {
+    static constexpr unsigned BUCKETS = 25;
+    uint64_t count = 0, mean = 0, p50 = 0, p90 = 0, p99 = 0, max = 0; // percentiles at their bucket's upper end
+    std::array<uint64_t, BUCKETS> buckets{};
+};
+
+// Microseconds in power-of-two buckets: bucket 0 holds 0 and 1, bucket b [2^b, 2^(b + 1)) and the
+// last one everything from 2^24 (17 s) on. record() is a few relaxed atomics and never blocks.
+class LatencyHistogram {
+public:
+    static constexpr unsigned BUCKETS = LatencySummary::BUCKETS;
+
+    void record(uint64_t micros) {
+        buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(micros, std::memory_order_relaxed);
+        for (auto seen = max.load(std::memory_order_relaxed);
+             micros > seen && !max.compare_exchange_weak(seen, micros, std::memory_order_relaxed);) {}
+    }
+
+    static unsigned bucketOf(uint64_t micros) {
+        unsigned ret = 0;
+        for (; micros > 1 && ret + 1 < BUCKETS; micros >>= 1) ++ret;
+        return ret;
+    }
+
+    [[nodiscard]] LatencySummary summary() const;
+
+    void reset();
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> sum{0}, max{0};
+};
+
+// One histogram per stage of LINK_LATENCY_STAGES
+class LatencyStats {
+public:
+#define X(name, side) LatencyHistogram name;
+    LINK_LATENCY_STAGES(X)
+#undef X
+
+    // The clock stages are measured with, in microseconds
+    static uint64_t now() {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Microseconds from since to now, 0 if since is not set
+    static uint64_t elapsed(uint64_t since) {
+        auto at = now();
+        return since != 0 && at > since ? at - since : 0;
+    }
+
+    // One row per stage: count, mean, percentiles, max and the bucket counts
+    [[nodiscard]] std::string csv() const;
+
+    // Writes csv() to path; false if it cannot be opened
+    bool save(const std::string &path) const;
+
+    void reset();
+};
+
+struct StatsSnapshot {
+#define X(name, layer) uint64_t name = 0;
+    LINK_STATS_COUNTERS(X)
+#undef X
+#define X(name, layer) int64_t name = 0;
+    LINK_STATS_GAUGES(X)
+#undef X
+    double seconds = 0;
+
+    // Fraction of the elapsed audio samples that carried our own transmission
+    [[nodiscard]] double airtime() const {
+        return samplesElapsed ? (double) samplesTransmitted / (double) samplesElapsed : 0.0;
+    }
+
+    [[nodiscard]] static std::string csvHeader();
+
+    [[nodiscard]] std::string csvRow() const;
+
+    [[nodiscard]] std::string json() const;
+};
+
+class LinkStats {
+public:
+#define X(name, layer) std::atomic<uint64_t> name{0};
+    LINK_STATS_COUNTERS(X)
+#undef X
+#define X(name, layer) std::atomic<int64_t> name{0};
+    LINK_STATS_GAUGES(X)
+#undef X
+    LatencyStats latency;
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t value = 1) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void set(std::atomic<int64_t> &gauge, int64_t value) { gauge.store(value, std::memory_order_relaxed); }
+
+    [[nodiscard]] StatsSnapshot snapshot() const;
+
+    void reset();
+
+private:
+    // steady_clock ticks since its epoch; reset() writes it while the exporter reads it
+    std::atomic<int64_t> start{std::chrono::steady_clock::now().time_since_epoch().count()};
+};
+
+class StatsExporter {
+public:
+    StatsExporter() = default;
+
+    StatsExporter(const StatsExporter &) = delete;
+
+    ~StatsExporter() { stop(); }
+
+    // Dump stats every intervalMs milliseconds; returns false if the file cannot be opened
+    bool start(const LinkStats *source, const std::string &path, int intervalMs = 1000);
+
+    void stop();
+
+private:
+    void dump();
+
+    const LinkStats *stats{nullptr};
+    FILE *out{nullptr};
+    bool json{false};
+    std::thread worker;
+    std::atomic<bool> running{false};
+};
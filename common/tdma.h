@@ -0,0 +1,317 @@
+#ifndef TDMA_H
+#define TDMA_H
+
+#include "frame.h"
+#include "handshake.h"
+#include "mac.h"
+#include "pool.h"
+#include "rate.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "trace.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+// How the master splits a superframe between the two nodes
+enum class SlotAllocation { Static, Demand };
+
+/* TDMA MAC
+ *
+ * Node1 is the master and keeps the time. A superframe is Config::TDMA_SLOTS slots, each the airtime
+ * of one MTU frame and one ACK, split into two turns. The master's turn takes the first slots and
+ * starts with a beacon saying how many, Node2's turn takes the rest and starts with its demand.
+ * Every turn ends with TDMA_GUARD_SAMPLES of silence. Node2 places its turn relative to the sample
+ * it heard the beacon at, so no node ever listens before transmit, defers or collides.
+ *
+ * Within its turn a node sends back to back: ACKs for what it received, the frames still not
+ * acknowledged since its last turn, then new frames, as long as they end before the guard. Static
+ * allocation gives each node half of the slots; demand-weighted allocation splits them by the
+ * airtime each node has queued, which Node2 reports at the start of every turn.
+ *
+ * Control frames have SEQ 0, which no data frame or ACK uses; those of the Handshake are answered
+ * outside the turns. Frames are cut to the BODY the handshake agreed on. Data frames go at the payload rate
+ * RateControl picks; a frame still not acknowledged when the node's next turn comes counts as a
+ * failure of the rate it went at.
+ *
+ * Like Mac::transfer(), received frames go through Reassembly and straight back to the pool, and a
+ * frame is built by makeFrame each time it goes on air.
+ */
+template<class Config>
+class TdmaMac {
+public:
+    using Frame = FrameType<Config>;
+    using LENType = typename Config::LENType;
+    using SEQType = typename Config::SEQType;
+
+    TdmaMac() = delete;
+
+    TdmaMac(const TdmaMac &) = delete;
+
+    TdmaMac(const TdmaMac &&) = delete;
+
+    explicit TdmaMac(FrameQueue<Config> *bufferIn, Writer<Config> *writerPtr, LinkStats *statsPtr,
+                     Handshake<Config> *handshakePtr, SlotAllocation slotAllocation) :
+            input(bufferIn), writer(writerPtr), stats(statsPtr), handshake(handshakePtr),
+            allocation(slotAllocation), rate(statsPtr) {
+        // as many frames as SEQ numbers, so no transfer allocates
+        auto most = (size_t) std::numeric_limits<SEQType>::max();
+        bitLengths.reserve(most);
+        resendsLeft.reserve(most);
+        acked.reserve(most);
+        awaiting.reserve(most);
+        acks.reserve(Reassembly<Config>::REORDER);
+    }
+
+    // Same contract as Mac::transfer
+    TransferResult transfer(bool isNode1, const std::string &data, int resendTimes) {
+        TransferResult result;
+        PayloadDecoder decoder(result.received);
+        received.reset(&decoder);
+        trace::nameThread("MAC");
+        auto agreed = handshake->agreed();
+        payload = &data;
+        node1 = isNode1;
+        maxBody = agreed.maxBody;
+        frameNum = Config::transferFrames(data.size(), maxBody);
+        bitLengths.assign(frameNum, Config::LENGTH_OF_ONE_BIT);
+        resendsLeft.assign(frameNum, resendTimes);
+        acked.assign(frameNum, false);
+        awaiting.assign(frameNum, false);
+        rate.reset();
+        rate.allow(agreed.rates);
+        ackedCount = 0;
+        nextNew = 0;
+        acks.clear();
+        startMicros = LatencyStats::now();
+        peerDemand = Config::TDMA_SLOTS;
+        // master: start of the next superframe; Node2: its next turn, once a beacon announced it
+        uint64_t turnStart = writer->now() + 2 * LEAD, turnEnd = 0, lastBeacon = 0;
+        bool turnPending = isNode1, heardBeacon = false, done = false;
+        int lingered = 0; // turns served since done
+        MyTimer testTotalTime;
+        while (true) {
+            for (TransmissionReport report; writer->popReport(report);) {}
+            // try to receive a frame, an ACK or a control frame
+            for (FrameHandle<Config> frame; input->pop(frame);) {
+                // a missing frame goes again in the sender's next turn anyway
+                if (frame->damaged || frame->isNack()) continue;
+                if (frame->seq == 0) {
+                    if (handshake->handle(isNode1, *frame)) continue;
+                    if (!isNode1 && frame->len == BEACON_LENGTH && frame->body[0] == BEACON) {
+                        auto beaconStart = frame->receivedAt - Config::PREAMBLE_SAMPLES;
+                        turnStart = beaconStart + turnSamples((unsigned) frame->body[1]);
+                        turnEnd = beaconStart + SUPERFRAME;
+                        turnPending = heardBeacon = true;
+                        lastBeacon = writer->now();
+                        TRACE(trace::Event::Beacon, frame->body[1], frame->body[2]);
+                        LinkStats::add(stats->beaconsReceived);
+                        LinkStats::set(stats->slotsOwned, frame->body[2]);
+                    } else if (isNode1 && frame->len == DEMAND_LENGTH && frame->body[0] == DEMAND) {
+                        peerDemand = (unsigned) frame->body[1];
+                    }
+                    continue;
+                }
+                auto seqNum = (unsigned) abs(frame->seq);
+                bool mine = isNode1 == (frame->seq > 0);
+                if (frame->len != 0 && !mine) {
+                    TRACE(trace::Event::FrameReceived, frame->seq);
+                    LinkStats::add(stats->framesReceived);
+                    rate.observeSnr(frame->snrDb);
+                    // beyond what Reassembly holds it goes unacknowledged and comes again next turn
+                    if (!received.accept(seqNum, *frame)) continue;
+                    acks.push_back({frame->seq, frame->deliveredMicros});
+                    // every frame from the other Node is received
+                    received.finish(result, testTotalTime.duration());
+                } else if (frame->len == 0 && mine && seqNum <= frameNum && !acked[seqNum - 1]) {
+                    acked[seqNum - 1] = true;
+                    if (awaiting[seqNum - 1]) rate.report(bitLengths[seqNum - 1], true);
+                    rate.observeSnr(frame->snrDb);
+                    TRACE(trace::Event::AckReceived, frame->seq, resendsLeft[seqNum - 1]);
+                    LinkStats::add(stats->acksReceived);
+                    result.ACKedAll = ++ackedCount == frameNum;
+                }
+            }
+            if (!done && result.ACKedAll && received.done()) {
+                done = true;
+                result.totalSeconds = testTotalTime.duration();
+            }
+            // keep answering for a few superframes, in case our last ACKs got lost
+            if (done && lingered >= LINGER) return result;
+            auto now = writer->now();
+            auto beaconTimeout = (uint64_t) (done ? LINGER : resendTimes) * SUPERFRAME;
+            if (!isNode1 && heardBeacon && now > lastBeacon + beaconTimeout) {
+                if (done) return result;
+                TRACE(trace::Event::LinkError, 0);
+                LinkStats::add(stats->linkErrors);
+                fprintf(stderr, "Link error detected! no beacon for %d superframes...\n", resendTimes);
+                result.totalSeconds = testTotalTime.duration();
+                return result;
+            }
+            if (turnPending && now + LEAD >= turnStart) {
+                // a late turn starts as soon as it can and still ends on time
+                auto start = std::max(turnStart, now + LEAD / 2);
+                bool planned;
+                if (isNode1) {
+                    auto slots = masterSlots();
+                    char body[BEACON_LENGTH]{BEACON, (char) slots, (char) (Config::TDMA_SLOTS - slots)};
+                    TRACE(trace::Event::Beacon, body[1], body[2], (int32_t) peerDemand);
+                    LinkStats::add(stats->beaconsSent);
+                    LinkStats::set(stats->slotsOwned, slots);
+                    planned = planTurn(start, turnStart + turnSamples(slots), Frame(BEACON_LENGTH, 0, body));
+                    turnStart += SUPERFRAME;
+                    if (turnStart < start) turnStart = start + SUPERFRAME;
+                } else {
+                    char body[DEMAND_LENGTH]{DEMAND, (char) demandSlots()};
+                    planned = planTurn(start, turnEnd, Frame(DEMAND_LENGTH, 0, body));
+                    turnPending = false;
+                }
+                if (!planned) {
+                    result.totalSeconds = testTotalTime.duration();
+                    return result;
+                }
+                if (done) ++lingered;
+            }
+            Thread::sleep(1);
+        }
+    }
+
+private:
+    static_assert(Config::TDMA_SLOTS >= 2 && Config::TDMA_SLOTS <= 127, "each node needs a slot");
+
+    static constexpr char BEACON = 'B', DEMAND = 'D';
+    static constexpr LENType BEACON_LENGTH = 3; // BEACON, master slots, Node2 slots
+    static constexpr LENType DEMAND_LENGTH = 2; // DEMAND, slots Node2 could fill
+
+    static constexpr uint64_t SLOT_SAMPLES =
+            Config::frameSamples(Config::MAX_LENGTH_BODY) + Config::frameSamples(0);
+    static constexpr uint64_t CONTROL_SAMPLES = Config::frameSamples(BEACON_LENGTH);
+    static constexpr uint64_t SUPERFRAME =
+            2 * (CONTROL_SAMPLES + Config::TDMA_GUARD_SAMPLES) + Config::TDMA_SLOTS * SLOT_SAMPLES;
+    static constexpr uint64_t LEAD = Config::TDMA_GUARD_SAMPLES / 2; // a turn is planned this many samples ahead
+    static constexpr int LINGER = 3; // superframes served after the transfer is done
+
+    static constexpr uint64_t turnSamples(unsigned slots) {
+        return CONTROL_SAMPLES + slots * SLOT_SAMPLES + Config::TDMA_GUARD_SAMPLES;
+    }
+
+    // Schedules control and whatever fits after it into [start, end - guard); false on a link error
+    bool planTurn(uint64_t start, uint64_t end, const Frame &control) {
+        uint64_t at = start;
+        int32_t frames = 0, ackCount = 0;
+        auto fits = [&](const Frame &frame) {
+            return at + Config::frameSamples(frame.len, frame.bitLength) + Config::TDMA_GUARD_SAMPLES <= end;
+        };
+        auto put = [&](const Frame &frame) {
+            writer->send(frame, at);
+            at += Config::frameSamples(frame.len, frame.bitLength);
+        };
+        put(control);
+        size_t acksPut = 0;
+        for (Frame ack; acksPut < acks.size() && fits(ack = Frame(0, acks[acksPut].seq, nullptr)); ++acksPut) {
+            put(ack);
+            stats->latency.ackTurnaround.record(LatencyStats::elapsed(acks[acksPut].deliveredMicros));
+            ++ackCount;
+            TRACE(trace::Event::AckSent, ack.seq);
+            LinkStats::add(stats->acksSent);
+        }
+        acks.erase(acks.begin(), acks.begin() + (ptrdiff_t) acksPut);
+        // resend what the other node did not acknowledge in its turn
+        for (size_t i = 0; i < nextNew; ++i) {
+            if (acked[i]) continue;
+            if (awaiting[i]) {
+                rate.report(bitLengths[i], false);
+                awaiting[i] = false;
+                bitLengths[i] = (unsigned char) rate.pick();
+            }
+            auto again = sentFrame(i);
+            if (!fits(again)) continue;
+            if (resendsLeft[i] == 0) {
+                TRACE(trace::Event::LinkError, again.seq);
+                LinkStats::add(stats->linkErrors);
+                fprintf(stderr, "Link error detected! frame seq = %d resend too many times...\n", again.seq);
+                return false;
+            }
+            put(again);
+            awaiting[i] = true;
+            ++frames;
+            TRACE(trace::Event::FrameResent, again.seq, --resendsLeft[i]);
+            LinkStats::add(stats->framesResent);
+        }
+        for (; nextNew < frameNum; ++nextNew) {
+            bitLengths[nextNew] = (unsigned char) rate.pick();
+            auto next = sentFrame(nextNew);
+            if (!fits(next)) break;
+            stats->latency.macQueue.record(LatencyStats::elapsed(startMicros));
+            put(next);
+            awaiting[nextNew] = true;
+            ++frames;
+            TRACE(trace::Event::FrameSent, next.seq);
+            LinkStats::add(stats->framesSent);
+        }
+        TRACE(trace::Event::TurnPlanned, frames, ackCount, (int32_t) (end - std::min(at, end)));
+        LinkStats::set(stats->windowInUse, (int64_t) (nextNew - std::min(ackedCount, nextNew)));
+        return true;
+    }
+
+    // Slots this node could fill: pending ACKs and every frame not acknowledged yet
+    [[nodiscard]] unsigned demandSlots() const {
+        uint64_t samples = acks.size() * Config::frameSamples(0);
+        for (size_t i = 0; i < frameNum; ++i)
+            if (!acked[i]) samples += Config::frameSamples(lengthOf(i), bitLengths[i]);
+        return (unsigned) std::min<uint64_t>((samples + SLOT_SAMPLES - 1) / SLOT_SAMPLES, Config::TDMA_SLOTS);
+    }
+
+    // Frame i of the running transfer, at the rate it goes at now
+    [[nodiscard]] Frame sentFrame(size_t i) const {
+        auto ret = makeFrame<Config>(node1, *payload, maxBody, i);
+        ret.bitLength = bitLengths[i];
+        return ret;
+    }
+
+    // LEN of sentFrame(i), without building it
+    [[nodiscard]] size_t lengthOf(size_t i) const {
+        return i == 0 ? Config::LENGTH_SEQ : std::min<size_t>(maxBody, payload->size() - (i - 1) * maxBody);
+    }
+
+    [[nodiscard]] unsigned masterSlots() const {
+        constexpr unsigned N = Config::TDMA_SLOTS;
+        auto own = demandSlots();
+        if (allocation == SlotAllocation::Static || own + peerDemand == 0) return N / 2;
+        auto share = (unsigned) std::lround((double) N * own / (double) (own + peerDemand));
+        return std::clamp(share, 1u, N - 1);
+    }
+
+    FrameQueue<Config> *input{nullptr};
+    Writer<Config> *writer;
+    LinkStats *stats;
+    Handshake<Config> *handshake;
+    SlotAllocation allocation;
+
+    // state of the running transfer: its frames are built from payload whenever they go on air
+    const std::string *payload{nullptr};
+    bool node1{true};
+    unsigned maxBody{0};
+    size_t frameNum{0};
+    std::vector<unsigned char> bitLengths; // RATE each frame goes at
+    std::vector<int> resendsLeft;
+    std::vector<bool> acked;
+    std::vector<bool> awaiting; // sent and not judged yet, for rate
+    size_t ackedCount{0}, nextNew{0};
+    struct PendingAck {
+        SEQType seq;
+        uint64_t deliveredMicros; // of the frame it acknowledges
+    };
+
+    std::vector<PendingAck> acks; // to send in the next turn, oldest first
+    uint64_t startMicros{0};     // LatencyStats::now() when the data was handed over
+    unsigned peerDemand{0};      // slots Node2 reported, the master only
+    RateControl<Config> rate;
+    Reassembly<Config> received;
+};
+
+#endif//TDMA_H
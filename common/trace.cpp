@@ -0,0 +1,76 @@
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace trace {
+
+namespace {
+std::mutex registryLock;
+std::vector<std::unique_ptr<Ring>> rings; // never shrinks, so the drainer may outlive the producers
+
+std::thread drainer;
+std::atomic<bool> running{false};
+FILE *out = nullptr;
+
+void drainOnce() {
+    static Record batch[1024];
+    std::vector<Ring *> snapshot;
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+        for (auto &ring: rings) snapshot.push_back(ring.get());
+    }
+    for (auto ring: snapshot) {
+        for (unsigned n; (n = ring->pop(batch, 1024)) != 0;) fwrite(batch, sizeof(Record), n, out);
+        if (auto lost = ring->dropped.exchange(0)) {
+            Record record{0, (uint16_t) Event::Dropped, ring->id, (int32_t) lost, ring->id, 0};
+            fwrite(&record, sizeof(Record), 1, out);
+        }
+    }
+    fflush(out);
+}
+}// namespace
+
+Ring &localRing() {
+    thread_local Ring *ring = [] {
+        std::lock_guard<std::mutex> guard(registryLock);
+        rings.emplace_back(new Ring((uint16_t) rings.size()));
+        return rings.back().get();
+    }();
+    return *ring;
+}
+
+void nameThread(const char *name) {
+    int32_t packed[3]{};
+    memcpy(packed, name, std::min(strlen(name), sizeof(packed)));
+    emit(Event::ThreadName, packed[0], packed[1], packed[2]);
+}
+
+bool start(const char *path, int drainIntervalMs) {
+    if (running) return true;
+    out = fopen(path, "wb");
+    if (out == nullptr) return false;
+    fwrite("P2TRACE1", 1, 8, out);
+    running = true;
+    drainer = std::thread([drainIntervalMs] {
+        while (running) {
+            drainOnce();
+            std::this_thread::sleep_for(std::chrono::milliseconds(drainIntervalMs));
+        }
+    });
+    return true;
+}
+
+void stop() {
+    if (!running) return;
+    running = false;
+    drainer.join();
+    drainOnce();
+    fclose(out);
+    out = nullptr;
+}
+
+}// namespace trace
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/* Low-overhead binary event tracing
+ *
+ * Every thread that emits an event owns a lock-free single-producer ring of fixed-size records,
+ * so TRACE() costs one clock read and a few stores. A background drainer copies the rings into
+ * a binary file, and trace_decode.py turns that file into a timeline.
+ *
+ * File layout: "P2TRACE1" followed by Record[] in drain order (not globally sorted).
+ */
+
+#ifndef PROJECT2_TRACE
+#define PROJECT2_TRACE 1
+#endif
+
+namespace trace {
+
+// Keep in sync with EVENT_NAMES in trace_decode.py
+enum class Event : uint16_t {
+    ThreadName = 0,     // a, b, c: up to 12 characters of the thread name
+    Dropped,            // a: records lost because a ring was full, b: thread
+    PreambleDetected,   // a: preamble level in millionths of full scale, b: SNR in tenths of dB
+    DiscardLength,      // a: len, b: seq
+    DiscardCRC,         // a: len, b: seq
+    FrameDelivered,     // a: len, b: seq
+    WriterDefer,        // a: defer time in us
+    WriterQueued,       // a: len, b: seq, c: samples queued
+    FrameSent,          // a: seq
+    FrameResent,        // a: seq, b: resend times left
+    FrameReceived,      // a: seq
+    AckSent,            // a: seq
+    AckReceived,        // a: seq, b: resend times left
+    LinkError,          // a: seq
+    PingSent,           // a: seq
+    PingReply,          // a: RTT in us, b: RTT in samples from the end of the ping on air
+    PingTimeout,        //
+    ChannelEmpty,       // a: periods
+    CandidateOverrun,   // a: len, b: seq, as far as they were read
+    CandidateDropped,   //
+    DuplicateFrame,     // a: len, b: seq
+    TransmissionDone,   // a: id, b: samples late, c: samples played
+    Beacon,             // a: master slots, b: Node2 slots, c: demand of Node2 in slots
+    TurnPlanned,        // a: frames, b: ACKs, c: samples of the turn left idle
+    RateChanged,        // a: samples per bit of the payload, b: peer SNR in tenths of dB, c: its success in percent
+    CreditGranted,      // a: stream, b: bytes the peer may send beyond what we delivered
+    CreditStalled,      // a: stream, b: bytes waiting to be sent
+    FrameDropped,       // a: len, b: seq, c: frames left in the pool
+    NackSent,           // a: seq
+    FastRetransmit,     // a: seq, b: resend times left, c: 1 after a NACK, 0 after later ACKs
+    Handshake,          // a: agreed BODY bytes, b: agreed window, c: agreed bit lengths, bit b for b samples
+    NumEvents
+};
+
+struct Record {
+    uint64_t timestamp; // steady_clock nanoseconds
+    uint16_t event;
+    uint16_t thread;
+    int32_t a, b, c;
+};
+
+static_assert(sizeof(Record) == 24, "trace records are written to disk as-is");
+
+constexpr unsigned RING_SIZE = 1 << 13; // records per thread, must be a power of two
+
+class Ring {
+public:
+    explicit Ring(uint16_t threadId) : id(threadId) {}
+
+    // Producer side, only called by the owning thread
+    void push(Event event, int32_t a, int32_t b, int32_t c) {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == RING_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        records[h & (RING_SIZE - 1)] = {(uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+                                        (uint16_t) event, id, a, b, c};
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // Consumer side, only called by the drainer; returns the number of records copied
+    unsigned pop(Record *dst, unsigned maxCount) {
+        auto t = tail.load(std::memory_order_relaxed);
+        auto n = (unsigned) std::min<uint64_t>(head.load(std::memory_order_acquire) - t, maxCount);
+        for (unsigned i = 0; i < n; ++i) dst[i] = records[(t + i) & (RING_SIZE - 1)];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    const uint16_t id;
+    std::atomic<uint64_t> dropped{0};
+
+private:
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    Record records[RING_SIZE]{};
+};
+
+// Ring of the calling thread, registered on first use
+Ring &localRing();
+
+// Emit a ThreadName record for the calling thread
+void nameThread(const char *name);
+
+// Start the background drainer writing to path; returns false if the file cannot be opened
+bool start(const char *path, int drainIntervalMs = 10);
+
+// Drain everything that is left and close the file
+void stop();
+
+inline void emit(Event event, int32_t a = 0, int32_t b = 0, int32_t c = 0) {
+    localRing().push(event, a, b, c);
+}
+
+}// namespace trace
+
+#if PROJECT2_TRACE
+#define TRACE(...) trace::emit(__VA_ARGS__)
+#else
+#define TRACE(...) ((void) 0)
+#endif
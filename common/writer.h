@@ -0,0 +1,140 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "band.h"
+#include "frame.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "trace.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <ostream>
+#include <vector>
+
+/* Modulates frames and queues them for the audio callback
+ *
+ * A link has one or more lanes, audio channels with an OutputScheduler and carrier sense each.
+ * Frames sent ASAP without a lane are striped over the lanes in use (useLanes()): each goes to the
+ * one with the least queued, taking turns on a tie. Frames with a sample to start at go to lane 0,
+ * whose clock is that of all of them, since one callback feeds every lane. Transmission ids tell
+ * the lane, see laneOf(). With Config::BAND_SPLIT frames go on the carrier of the node set with
+ * setNode() and never listen before transmit, the other node is on a band of its own.
+ *
+ * send() times the carrier sense and the rendering of every frame, and popReport() how long it
+ * waited for the audio callback and how long it was on air, into LinkStats::latency.
+ */
+template<class Config>
+class Writer {
+public:
+    using Frame = FrameType<Config>;
+
+    static constexpr unsigned ANY_LANE = ~0u;
+
+    Writer() = delete;
+
+    Writer(const Writer &) = delete;
+
+    Writer(const Writer &&) = delete;
+
+    // bufferOut and quietPtr point to one per lane
+    explicit Writer(OutputScheduler *bufferOut, Atomic<bool> *quietPtr, LinkStats *statsPtr, unsigned laneCount = 1) :
+            output(bufferOut), quiet(quietPtr), stats(statsPtr), lanes(laneCount) {}
+
+    // Queues the frame to start at sample at of the output clock, or after listening before transmit
+    // if at is ASAP; returns the id its TransmissionReport will carry
+    uint64_t send(const Frame &frame, uint64_t at = OutputScheduler::ASAP, unsigned lane = ANY_LANE) {
+        lane = lane < lanes ? lane : at == OutputScheduler::ASAP ? pickLane() : 0;
+        // listen before transmit, a scheduled frame owns its time already
+        if (at == OutputScheduler::ASAP && !Config::BAND_SPLIT) {
+            MyTimer testNoisyTime;
+            while (!quiet[lane].get());
+            auto deferMicros = (int32_t) (testNoisyTime.duration() * 1e6);
+            stats->latency.carrierSense.record((uint64_t) deferMicros);
+            if (deferMicros > 1000) {
+                TRACE(trace::Event::WriterDefer, deferMicros);
+                LinkStats::add(stats->deferCount);
+                LinkStats::add(stats->deferMicros, deferMicros);
+            }
+        }
+        // transmit; the lock only orders senders, the audio callback never takes it
+        protectOutput.enter();
+        auto renderStart = LatencyStats::now();
+        std::string str = std::string(Config::preamble, Config::LENGTH_PREAMBLE) + frame.wholeString() +
+                          inString(frame.crc());
+        samples.clear();
+        for (size_t i = 0; i < str.size(); ++i) {
+            unsigned bitLength = i < Config::OFFSET_BODY ? Config::LENGTH_OF_ONE_BIT : frame.bitLength;
+            for (int bitPos = 0; bitPos < 8; ++bitPos) {
+                auto first = str[i] >> bitPos & 1 ? 1.0f : -1.0f;
+                for (unsigned k = 0; k < bitLength; ++k) samples.push_back(k < bitLength / 2 ? first : -first);
+            }
+        }
+        if constexpr (Config::BAND_SPLIT)
+            keyCarrier<Config>(samples.data(), samples.size(), node1.load(std::memory_order_relaxed));
+        uint64_t id;
+        while (!output[lane].schedule(samples.data(), samples.size(), at, id)) Thread::yield();
+        stats->latency.render.record(LatencyStats::elapsed(renderStart));
+        TRACE(trace::Event::WriterQueued, frame.len, frame.seq, (int32_t) output[lane].backlog());
+        LinkStats::add(stats->framesQueued);
+        LinkStats::set(stats->outputBacklog, (int64_t) output[lane].backlog());
+        protectOutput.exit();
+        return id * lanes + lane;
+    }
+
+    // The next transmission that finished playing on any lane; only one thread may poll
+    bool popReport(TransmissionReport &report) {
+        for (unsigned i = 0; i < lanes; ++i, polled = (polled + 1) % lanes) {
+            if (!output[polled].popReport(report)) continue;
+            report.id = report.id * lanes + polled;
+            polled = (polled + 1) % lanes;
+            // a scheduled frame waits for its sample on purpose
+            if (report.requested == OutputScheduler::ASAP)
+                stats->latency.outputQueue.record(Config::samplesToMicros(report.waited()));
+            stats->latency.airtime.record(Config::samplesToMicros(report.end - report.start));
+            TRACE(trace::Event::TransmissionDone, (int32_t) report.id, (int32_t) report.lateness(),
+                  (int32_t) (report.end - report.start));
+            return true;
+        }
+        return false;
+    }
+
+    // The sample the audio callback plays next
+    [[nodiscard]] uint64_t now() const { return output->now(); }
+
+    // Stripes frames over the first count lanes from now on, at least lane 0
+    void useLanes(unsigned count) { active.store(std::clamp(count, 1u, lanes), std::memory_order_relaxed); }
+
+    [[nodiscard]] unsigned laneCount() const { return lanes; }
+
+    // Which node's carrier frames go on from now on, see band.h; Node1 until told otherwise
+    void setNode(bool isNode1) { node1.store(isNode1, std::memory_order_relaxed); }
+
+    // The lane a transmission went on
+    [[nodiscard]] unsigned laneOf(uint64_t id) const { return (unsigned) (id % lanes); }
+
+private:
+    unsigned pickLane() {
+        auto count = active.load(std::memory_order_relaxed);
+        auto first = turn.fetch_add(1, std::memory_order_relaxed) % count, best = first;
+        for (unsigned i = 1; i < count; ++i) {
+            auto lane = (first + i) % count;
+            if (output[lane].backlog() < output[best].backlog()) best = lane;
+        }
+        return best;
+    }
+
+    OutputScheduler *output{nullptr};
+    CriticalSection protectOutput;
+    std::vector<float> samples;
+    Atomic<bool> *quiet;
+    LinkStats *stats;
+    unsigned lanes;
+    std::atomic<unsigned> active{1}; // lanes in use
+    std::atomic<unsigned> turn{0};   // the lane a tie goes to
+    std::atomic<bool> node1{true};   // whose carrier, with Config::BAND_SPLIT
+    unsigned polled{0};              // the lane popReport() looks at first
+};
+
+#endif//WRITER_H
@@ -1,10 +1,12 @@
+#include "audio_block.h"
 #include "reader.h"
+#include "ring.h"
 #include "utils.h"
 #include <JuceHeader.h>
 #include <chrono>
 #include <fstream>
-#include <queue>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #pragma once
@@ -13,7 +15,7 @@ using std::chrono::duration_cast;
 using std::chrono::high_resolution_clock;
 using std::chrono::milliseconds;
 
-class MainContentComponent : public juce::AudioAppComponent {
+class MainContentComponent : public juce::AudioAppComponent, private juce::Timer {
 public:
     MainContentComponent() {
         titleLabel.setText("Part1", juce::NotificationType::dontSendNotification);
@@ -30,14 +32,11 @@ public:
             if (status != 0) return;
             std::ifstream f("INPUT.bin", std::ios::binary | std::ios::in);
             assert(f.is_open());
-            char c;
             binaryOutputLock.enter();
-            while (f.get(c)) {
-                for (int i = 7; i >= 0; i--) { binaryOutput.push(static_cast<bool>((c >> i) & 1)); }
-            }
+            // every byte goes MSB first
+            for (char c; f.get(c);) binaryOutput.write(BitStream::reverse((uint8_t) c), 8);
             binaryOutputLock.exit();
-            generateOutput();
-            status = 1;
+            if (generateOutput()) status = 1;
         };
         addAndMakeVisible(recordButton);
 
@@ -47,33 +46,29 @@ public:
         playbackButton.onClick = [this] {
             if (status != 0) return;
             std::ofstream f("OUTPUT.bin", std::ios::binary | std::ios::out);
-            auto count = 0;
-            char c = 0;
+            BitStream received;
             binaryInputLock.enter();
-            while (!binaryInput.empty()) {
-                auto temp = binaryInput.front();
-                binaryInput.pop();
-                ++count;
-                c <<= 1;
-                c = temp ? char(c + 1) : char(c);
-                if (count % 8 == 0) {
-                    f << c;
-                    c = 0;
-                }
-            }
+            std::swap(received, binaryInput);
             binaryInputLock.exit();
+            // whole bytes only, MSB first
+            for (size_t i = 0; i + 8 <= received.size(); i += 8)
+                f.put((char) BitStream::reverse((uint8_t) received.read(i, 8)));
         };
         addAndMakeVisible(playbackButton);
 
         setSize(600, 300);
         setAudioChannels(1, 1);
+        startTimerHz(30);
     }
 
-    ~MainContentComponent() override { shutdownAudio(); }
+    ~MainContentComponent() override {
+        stopTimer();
+        shutdownAudio();
+    }
 
 private:
     void initThreads() {
-        reader = new Reader(&directInput, &directInputLock, &binaryInput, &binaryInputLock);
+        reader = new Reader(&directInput, &binaryInput, &binaryInputLock);
         reader->startThread();
     }
 
@@ -94,47 +89,42 @@ private:
         for (float &i: preamble) { i = sin(2.0f * PI * i); }
 
         initThreads();
+        channels.update(deviceManager.getCurrentAudioDevice());
     }
 
     void getNextAudioBlock(const juce::AudioSourceChannelInfo &bufferToFill) override {
-        auto *device = deviceManager.getCurrentAudioDevice();
-        auto activeInputChannels = device->getActiveInputChannels();
-        auto activeOutputChannels = device->getActiveOutputChannels();
-        auto maxInputChannels = activeInputChannels.getHighestBit() + 1;
-        auto maxOutputChannels = activeOutputChannels.getHighestBit() + 1;
+        rtcheck::RealtimeScope realtime;
         auto buffer = bufferToFill.buffer;
         auto bufferSize = buffer->getNumSamples();
 
-        for (auto channel = 0; channel < maxOutputChannels; ++channel) {
-            if ((!activeInputChannels[channel] || !activeOutputChannels[channel]) || maxInputChannels == 0) {
+        for (auto channel = 0; channel < channels.numOutputs; ++channel) {
+            if (!channels.isLinked(channel)) {
                 bufferToFill.buffer->clear(channel, bufferToFill.startSample, bufferToFill.numSamples);
             } else {
                 if (status == 0) {
                     const float *data = buffer->getReadPointer(channel);
-                    directInputLock.enter();
-                    for (auto i = 0; i < bufferSize; ++i) { directInput.push(data[i]); }
-                    directInputLock.exit();
+                    directInput.push(data, (size_t) bufferSize);
                     buffer->clear();
                 } else if (status == 1) {
                     float *writePosition = buffer->getWritePointer(channel);
-                    directOutputLock.enter();
-                    for (int i = 0; i < bufferSize; ++i) {
-                        if (directOutput.empty()) {
-                            std::cout << "Finish sending!" << std::endl;
-                            status = 0;
-                            break;
-                        }
-                        auto temp = directOutput.front();
-                        writePosition[i] = temp;
-                        directOutput.pop();
+                    auto written = (int) directOutput.pop(writePosition, (size_t) bufferSize);
+                    if (written < bufferSize) {
+                        // Finish sending! timerCallback() tells the user
+                        std::fill(writePosition + written, writePosition + bufferSize, 0.0f);
+                        status = 0;
                     }
-                    directOutputLock.exit();
                 }
             }
         }
+    }
 
-        const MessageManagerLock mmLock;
-        switch (status) {
+    // The label follows status from the message thread; the audio thread only flips the atomic
+    void timerCallback() override {
+        auto now = status.load();
+        if (now == shownStatus) return;
+        if (shownStatus == 1 && now == 0) std::cout << "Finish sending!" << std::endl;
+        shownStatus = now;
+        switch (now) {
             case 0:
                 titleLabel.setText("Part1", juce::NotificationType::dontSendNotification);
                 break;
@@ -146,46 +136,57 @@ private:
 
     void releaseResources() override { delete reader; }
 
-    void generateOutput() {
+    // Queues binaryOutput as samples and clears it; returns false, with nothing queued, if they do not fit
+    bool generateOutput() {
         auto count = 0;
         binaryOutputLock.enter();
-        directOutputLock.enter();
-        while (!binaryOutput.empty()) {
+        // the callback only plays once status is 1, so everything has to fit into the ring up front
+        auto frames = (binaryOutput.size() + BITS_PER_FRAME - 1) / BITS_PER_FRAME;
+        auto samples =
+                binaryOutput.size() * LENGTH_OF_ONE_BIT + frames * (10 + preamble.size() + LENGTH_OF_ONE_BIT * 8);
+        if (samples > SampleRing::capacity() - directOutput.size()) {
+            fprintf(stderr, "INPUT.bin needs %zu samples, the output ring only holds %zu; not sending it!\n", samples,
+                    SampleRing::capacity() - directOutput.size());
+            binaryOutput.clear();
+            binaryOutputLock.exit();
+            return false;
+        }
+        auto push = [this](float sample) { directOutput.push(sample); }; // fits, see above
+        for (BitCursor bits(binaryOutput); bits.left() > 0;) {
             if (count % BITS_PER_FRAME == 0) {
-                for (int i = 0; i < 10; ++i) { directOutput.push(0); }
-                for (auto i: preamble) { directOutput.push(i); }
-                for (int i = 0; i < LENGTH_OF_ONE_BIT * 8; ++i) { directOutput.push(0.45f); }
+                for (int i = 0; i < 10; ++i) { push(0); }
+                for (auto i: preamble) { push(i); }
+                for (int i = 0; i < LENGTH_OF_ONE_BIT * 8; ++i) { push(0.45f); }
             }
-            auto temp = binaryOutput.front();
-            binaryOutput.pop();
+            auto temp = bits.next();
             for (int i = 0; i < LENGTH_OF_ONE_BIT; ++i) {
                 if (temp) {
-                    directOutput.push(0.75f);
+                    push(0.75f);
                 } else {
-                    directOutput.push(0);
+                    push(0);
                 }
             }
             ++count;
         }
-        directOutputLock.exit();
+        binaryOutput.clear();
         binaryOutputLock.exit();
+        return true;
     }
 
 private:
     // Process Input
     Reader *reader{nullptr};
-    std::queue<float> directInput;
-    CriticalSection directInputLock;
-    std::queue<bool> binaryInput;
+    SampleRing directInput;
+    BitStream binaryInput;
     CriticalSection binaryInputLock;
 
     // Process Output
-    std::queue<bool> binaryOutput;
+    BitStream binaryOutput;
     CriticalSection binaryOutputLock;
-    std::queue<float> directOutput;
-    CriticalSection directOutputLock;
+    SampleRing directOutput;
 
     std::vector<float> preamble;
+    ChannelLayout channels;
 
     // GUI related
     juce::Label titleLabel;
@@ -193,6 +194,7 @@ private:
     juce::TextButton playbackButton;
 
     std::atomic<int> status{0};
+    int shownStatus{0};
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainContentComponent)
 };
@@ -1,11 +1,13 @@
 #ifndef READER_H
 #define READER_H
 
+#include "dsp.h"
+#include "ring.h"
 #include "utils.h"
 #include <JuceHeader.h>
 #include <cassert>
+#include <numeric>
 #include <ostream>
-#include <queue>
 
 class Reader : public Thread {
 public:
@@ -14,8 +16,8 @@ public:
     Reader(const Reader &&) = delete;
 
 
-    explicit Reader(std::queue<float> *bufferIn, CriticalSection *lockInput, std::queue<bool> *bufferOut, CriticalSection *lockOutput)
-        : Thread("Reader"), input(bufferIn), output(bufferOut), protectInput(lockInput), protectOutput(lockOutput) {
+    explicit Reader(SampleRing *bufferIn, BitStream *bufferOut, CriticalSection *lockOutput)
+        : Thread("Reader"), input(bufferIn), output(bufferOut), protectOutput(lockOutput) {
         auto sampleRate = 48000;
         std::vector<float> t;
         t.reserve((size_t) sampleRate);
@@ -27,10 +29,10 @@ public:
         f.insert(std::end(f), std::begin(f_temp), std::end(f_temp));
 
         std::vector<float> x(t.begin(), t.begin() + 240);
-        preamble = cumtrapz(x, f);
-        for (float &i: preamble) { i = sin(2.0f * PI * i); }
-
-        sync = std::deque<float>(240, 0);
+        auto preamble = cumtrapz(x, f);
+        for (float &i: preamble) { i = sin(2.0f * PI * i) / 100.0f; }
+        // correlating with the preamble is filtering with it reversed
+        sync = dsp::Fir(std::vector<float>(preamble.rbegin(), preamble.rend()));
     }
 
     ~Reader() override {
@@ -40,21 +42,14 @@ public:
     void run() override {
         assert(input != nullptr);
         assert(output != nullptr);
-        assert(protectInput != nullptr);
         assert(protectOutput != nullptr);
         while (!threadShouldExit()) {
-            protectInput->enter();
-            if (!input->empty()) {// Not fully utilized yet
-
-                float nextValue = input->front();
-                input->pop();
-                protectInput->exit();
+            float nextValue;
+            if (input->pop(nextValue)) {// Not fully utilized yet
 
                 power = power * (63.0f / 64.0f) + nextValue * nextValue / 64.0f;
                 if (state == 0) {
-                    sync.pop_front();
-                    sync.push_back(nextValue);
-                    auto syncPower = static_cast<float>(std::inner_product(sync.begin(), sync.end(), preamble.begin(), 0.0f) / 100.0f);
+                    auto syncPower = sync.processSample(nextValue);
                     if (syncPower > power * 2 && syncPower > syncPower_localMax && syncPower > 0.05f) {
                         syncPower_localMax = syncPower;
                         start_index = count;
@@ -62,9 +57,9 @@ public:
                         syncPower_localMax = 0;
                         state = 1;
                         //decode = std::vector<float>(inputBuffer.begin() + start_index + 1, inputBuffer.begin() + i + 1); // copy the last elements of sync
-                        decode = std::vector<float>(sync.end() - 110 - 1, sync.end());
+                        decode = std::vector<float>(sync.recent() + sync.taps() - 110 - 1, sync.recent() + sync.taps());
                         std::cout << "Header found" << std::endl;
-                        sync = std::deque<float>(240, 0);
+                        sync.reset();
                     }
                 } else {
                     decode.push_back(nextValue);
@@ -85,23 +80,19 @@ public:
                     }
                 }
                 ++count;
-            } else {
-                protectInput->exit();
             }
         }
     }
 
 private:
-    std::queue<float> *input{nullptr};
-    std::queue<bool> *output{nullptr};
-    CriticalSection *protectInput;
+    SampleRing *input{nullptr};
+    BitStream *output{nullptr};
     CriticalSection *protectOutput;
 
-    std::vector<float> preamble;
     int count{0};
     float power = 0;
     int start_index = -1;
-    std::deque<float> sync;
+    dsp::Fir sync{{}};
     std::vector<float> decode;
     float syncPower_localMax = 0;
     int state = 0;// 0 sync; 1 decode
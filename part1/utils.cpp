@@ -9,63 +9,55 @@ std::vector<float> linspace(float min, float max, int n) {
     return result;
 }
 
-std::vector<float> cumtrapz(std::vector<float> t, std::vector<float> f) {
+// The running total starts from t[0] where f[0] would belong; kept, Part1's preamble depends on it
+std::vector<float> cumtrapz(const std::vector<float> &t, const std::vector<float> &f) {
     //	assert(t.size() == f.size());
-    size_t size = t.size();
     std::vector<float> result;
-    result.reserve(size);
+    if (t.empty()) return result;
+    result.reserve(t.size());
     float total = 0.0;
-    float last = *t.begin();
+    float last = t.front();
     result.push_back(0);
-    for (int k = 0; k < size - 1; ++k) {
-        float d;
-        float s_tmp;
-        d = t[k + 1] - t[k];
-        t[k] = d;
-        s_tmp = f[k + 1];
-        total += d * ((last + s_tmp) / 2.0f);
-        last = s_tmp;
+    for (size_t k = 0; k + 1 < t.size(); ++k) {
+        total += (t[k + 1] - t[k]) * ((last + f[k + 1]) / 2.0f);
+        last = f[k + 1];
         result.push_back(total);
     }
     return result;
 }
 
-unsigned int crc(const std::vector<bool> &source) {
-    static unsigned char sourceString[20];
-    int stringLength = ((int) source.size() - 1) / 8 + 1;
-    for (int i = 0; i < stringLength; ++i) {
-        unsigned q = 0;
-        for (int j = 0; j < 8 && i * 8 + j < source.size(); ++j) q |= (int) source[i * 8 + j] << j;
-        sourceString[i] = q;
-    }
+unsigned int crc(const BitStream &source) {
     boost::crc_16_type crc;
-    crc.process_bytes(sourceString, stringLength);
+    source.process(crc);
     return crc.checksum();
 }
 
-bool crcCheck(std::vector<bool> source) {
+// The last 16 bits are the CRC, its bit 0 last
+bool crcCheck(const BitStream &source) {
+    if (source.size() < 16) return false;
+    auto bits = source.size() - 16;
     unsigned int check = 0;
-    for (int i = 0; i < 16; ++i) {
-        check |= *source.rbegin() << i;
-        source.pop_back();
-    }
-    return check == crc(source);
+    for (int i = 0; i < 16; ++i) check |= (unsigned) source[bits + 15 - i] << i;
+    boost::crc_16_type crc;
+    source.process(crc, bits);
+    return check == crc.checksum();
 }
 
+// Centered mean over span samples (rounded down to odd), narrower near the edges; the window
+// slides with a running sum, so the cost does not depend on span
 std::vector<float> smooth(const std::vector<float> &y, size_t span) {
     if (span == 0) { return y; }
     auto size = y.size();
-    auto smoothSize = ((span - 1) | 1);
+    auto half = ((span - 1) | 1) / 2;
     auto result = std::vector<float>{};
     result.reserve(size);
+    double sum = 0;
+    size_t lo = 0, hi = 0;// the window is y[lo, hi)
     for (size_t pos = 0; pos < size; ++pos) {
-        auto maxDistToEdge = std::min({smoothSize / 2, pos, size - pos - 1});
-        result.push_back(y[pos]);
-        for (auto i = 1; i <= maxDistToEdge; ++i) {
-            result[pos] += y[pos - i];
-            result[pos] += y[pos + i];
-        }
-        result[pos] /= (float) (maxDistToEdge * 2 + 1);
+        auto reach = std::min({half, pos, size - pos - 1});
+        for (; hi < pos + reach + 1; ++hi) sum += y[hi];
+        for (; lo < pos - reach; ++lo) sum -= y[lo];
+        result.push_back((float) (sum / (double) (hi - lo)));
     }
     return result;
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "bitstream.h"
 #include <boost/crc.hpp>
 #include <iostream>
 #include <vector>
@@ -13,11 +14,11 @@
 
 std::vector<float> linspace(float min, float max, int n);
 
-std::vector<float> cumtrapz(std::vector<float> t, std::vector<float> f);
+std::vector<float> cumtrapz(const std::vector<float> &t, const std::vector<float> &f);
 
-unsigned int crc(const std::vector<bool> &source);
+unsigned int crc(const BitStream &source);
 
-bool crcCheck(std::vector<bool> source);
+bool crcCheck(const BitStream &source);
 
 
 std::vector<float> smooth(const std::vector<float> &y, size_t span);
\ No newline at end of file
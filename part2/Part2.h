@@ -1,16 +1,20 @@
+#include "audio_block.h"
 #include "reader.h"
+#include "ring.h"
 #include "utils.h"
 #include "writer.h"
 #include <JuceHeader.h>
 #include <fstream>
+#include <iterator>
 #include <queue>
+#include <string>
 #include <thread>
 #include <vector>
 #include <map>
 
 #pragma once
 
-class MainContentComponent : public juce::AudioAppComponent {
+class MainContentComponent : public juce::AudioAppComponent, private juce::Timer {
 public:
     MainContentComponent() {
         titleLabel.setText("Part2", juce::NotificationType::dontSendNotification);
@@ -40,20 +44,18 @@ public:
             MyTimer testTotalTime;
             std::ifstream fIn("INPUT.bin", std::ios::binary | std::ios::in);
             assert(fIn.is_open());
-            std::vector<bool> data;
-            for (char c; fIn.get(c);) {
-                for (int i = 0; i < 8; ++i)
-                    data.push_back((bool) ((c >> i) & 1));
-            }
+            std::string bytes((std::istreambuf_iterator<char>(fIn)), std::istreambuf_iterator<char>());
+            BitStream data;
+            data.append(bytes.data(), bytes.size());
             int dataLength = (int) data.size();
             std::vector<FrameType> frameList(1, {0, 0}); // the first one is dummy
             for (int i = 0; i * MAX_LENGTH_BODY < dataLength; ++i) {
                 int len = std::min(MAX_LENGTH_BODY, dataLength - i * MAX_LENGTH_BODY);
-                FrameType frame(len, i + 1);
-                for (int j = 0; j < len; ++j)
-                    frame.frame[j] = data[i * MAX_LENGTH_BODY + j];
-                frameList.emplace_back(std::move(frame));
+                BitStream body;
+                body.append(data, (size_t) i * MAX_LENGTH_BODY, len);
+                frameList.emplace_back(std::move(body), i + 1);
             }
+            trace::nameThread("MAC");
             int LAR = 0, LFS = 0;
             std::vector<FrameWaitingInfo> info;
             while (LAR < frameList.rbegin()->seq) {
@@ -65,8 +67,7 @@ public:
                     int seq = -ACKFrame.seq;
                     if (LAR < seq && seq <= LFS) {
                         info[LFS - seq].receiveACK = true;
-                        fprintf(stderr, "ACK %d detected after waiting for %lfs\n", seq,
-                                info[LFS - seq].timer.duration() - info[LFS - seq].waitingTime);
+                        TRACE(trace::Event::AckReceived, seq, info[LFS - seq].resendTimes);
                     }
                 }
                 binaryInputLock.exit();
@@ -81,20 +82,21 @@ public:
                         info[LFS - seq].timer.duration() - info[LFS - seq].waitingTime < SLIDING_WINDOW_TIMEOUT)
                         continue;
                     if (info[LFS - seq].resendTimes == 0) {
+                        TRACE(trace::Event::LinkError, seq);
                         fprintf(stderr, "Link error detected! seq = %d\n", seq);
                         return;
                     }
                     info[LFS - seq].waitingTime = writer->send(frameList[seq]);
                     info[LFS - seq].timer.restart();
                     info[LFS - seq].resendTimes--;
-                    fprintf(stderr, "Frame resent, seq = %d\n", seq);
+                    TRACE(trace::Event::FrameResent, seq, info[LFS - seq].resendTimes);
                 }
                 // try to update LFS and send a frame
                 if (LFS - LAR < SLIDING_WINDOW_SIZE && LFS < frameList.rbegin()->seq) {
                     ++LFS;
                     info.insert(info.begin(), FrameWaitingInfo());
                     info.begin()->waitingTime = writer->send(frameList[LFS]);
-                    fprintf(stderr, "Frame sent, seq = %d\n", LFS);
+                    TRACE(trace::Event::FrameSent, LFS);
                 }
             }
             // all ACKs detected, tell the receiver client to terminate
@@ -108,6 +110,7 @@ public:
         saveButton.setSize(80, 40);
         saveButton.setCentrePosition(450, 140);
         saveButton.onClick = [this] {
+            trace::nameThread("MAC");
             int LFR = 0;
             std::map<int, FrameType> frameList;
             while (true) {
@@ -119,7 +122,7 @@ public:
                 FrameType frame = std::move(binaryInput.front());
                 binaryInput.pop();
                 binaryInputLock.exit();
-                fprintf(stderr, "frame received, seq = %d\n", frame.seq);
+                TRACE(trace::Event::FrameReceived, frame.seq);
                 // End of transmission
                 if (frame.seq == 0) break;
                 // Discard it because it's ACK sent by itself
@@ -129,101 +132,93 @@ public:
                 while (frameList.find(LFR + 1) != frameList.end()) ++LFR;
                 // send ACK
                 writer->send({0, -frame.seq});
-                fprintf(stderr, "ACK sent, seq = %d\n", -frame.seq);
+                TRACE(trace::Event::AckSent, -frame.seq);
             }
-            std::vector<bool> data;
-            for (auto const &iter: frameList)
-                for (auto b: iter.second.frame) data.push_back(b);
-            auto dataLength = data.size();
-            assert(dataLength % 8 == 0);
+            BitStream data;
+            for (auto const &iter: frameList) data.append(iter.second.frame, 0, iter.second.size());
+            assert(data.size() % 8 == 0);
             std::ofstream fOut("OUTPUT.bin", std::ios::binary | std::ios::out);
-            for (int i = 0; i < dataLength; i += 8) {
-                char c = 0;
-                for (int j = 0; j < 8; ++j)
-                    c = (char) (c | (data[i + j] << j));
-                fOut.put(c);
-            }
+            fOut.write((const char *) data.data(), (std::streamsize) (data.size() / 8));
         };
         addAndMakeVisible(saveButton);
 
         setSize(600, 300);
         setAudioChannels(1, 1);
+        startTimerHz(30);
     }
 
-    ~MainContentComponent() override { shutdownAudio(); }
+    ~MainContentComponent() override {
+        stopTimer();
+        shutdownAudio();
+    }
 
 private:
-    void initThreads() {
-        reader = new Reader(&directInput, &directInputLock, &binaryInput, &binaryInputLock);
+    void initThreads(double sampleRate) {
+        if (!trace::start("trace.bin")) fprintf(stderr, "failed to open trace.bin!\n");
+        reader = new Reader(&directInput, &binaryInput, &binaryInputLock);
         reader->startThread();
-        writer = new Writer(&directOutput, &directOutputLock);
+        writer = new Writer(&directOutput, sampleRate);
     }
 
-    void prepareToPlay([[maybe_unused]] int samplesPerBlockExpected, [[maybe_unused]] double sampleRate) override {
-        initThreads();
+    void prepareToPlay([[maybe_unused]] int samplesPerBlockExpected, double sampleRate) override {
+        initThreads(sampleRate);
+        channels.update(deviceManager.getCurrentAudioDevice());
         fprintf(stderr, "Main Thread Start\n");
     }
 
     void getNextAudioBlock(const juce::AudioSourceChannelInfo &bufferToFill) override {
-        auto *device = deviceManager.getCurrentAudioDevice();
-        auto activeInputChannels = device->getActiveInputChannels();
-        auto activeOutputChannels = device->getActiveOutputChannels();
-        auto maxInputChannels = activeInputChannels.getHighestBit() + 1;
-        auto maxOutputChannels = activeOutputChannels.getHighestBit() + 1;
+        rtcheck::RealtimeScope realtime;
         auto buffer = bufferToFill.buffer;
         auto bufferSize = buffer->getNumSamples();
 
-        for (auto channel = 0; channel < maxOutputChannels; ++channel) {
-            if ((!activeInputChannels[channel] || !activeOutputChannels[channel]) || maxInputChannels == 0) {
+        for (auto channel = 0; channel < channels.numOutputs; ++channel) {
+            if (!channels.isLinked(channel)) {
                 bufferToFill.buffer->clear(channel, bufferToFill.startSample, bufferToFill.numSamples);
             } else {
                 // Read in PHY layer
                 const float *data = buffer->getReadPointer(channel);
-                directInputLock.enter();
-                for (auto i = 0; i < bufferSize; ++i) { directInput.push(data[i]); }
-                directInputLock.exit();
+                directInput.push(data, (size_t) bufferSize);
                 buffer->clear();
                 // Write if PHY layer wants
                 float *writePosition = buffer->getWritePointer(channel);
-                directOutputLock.enter();
-                static int channelEmptyPeriods = 0;
                 if (directOutput.empty()) {
                     ++channelEmptyPeriods;
                 } else {
-                    if (channelEmptyPeriods)
-                        fprintf(stderr, "        Channel Empty for %d periods!!!!\n", channelEmptyPeriods);
+                    // hand the finished run to timerCallback(), which may trace
+                    if (channelEmptyPeriods) finishedEmptyPeriods.store(channelEmptyPeriods);
                     channelEmptyPeriods = 0;
                 }
-                for (int i = 0; i < bufferSize; ++i) {
-                    if (directOutput.empty()) {
-                        writePosition[i] = 0.45f;
-                        continue;
-                    }
-                    writePosition[i] = directOutput.front();
-                    directOutput.pop();
-                }
-                directOutputLock.exit();
+                auto written = (int) directOutput.pop(writePosition, (size_t) bufferSize);
+                std::fill(writePosition + written, writePosition + bufferSize, 0.45f);
             }
         }
     }
 
+    void timerCallback() override {
+        if (auto periods = finishedEmptyPeriods.exchange(0)) TRACE(trace::Event::ChannelEmpty, periods);
+    }
+
     void releaseResources() override {
         delete reader;
         delete writer;
+        trace::stop();
     }
 
 private:
     // Process Input
     Reader *reader{nullptr};
-    std::queue<float> directInput;
-    CriticalSection directInputLock;
+    SampleRing directInput;
     std::queue<FrameType> binaryInput;
     CriticalSection binaryInputLock;
 
     // Process Output
     Writer *writer{nullptr};
-    std::queue<float> directOutput;
-    CriticalSection directOutputLock;
+    SampleRing directOutput;
+
+    // Audio callback
+    ChannelLayout channels;
+    int channelEmptyPeriods{0};
+    std::atomic<int> finishedEmptyPeriods{0};
 
     // GUI related
     juce::Label titleLabel;
@@ -1,6 +1,8 @@
 #ifndef READER_H
 #define READER_H
 
+#include "ring.h"
+#include "trace.h"
 #include "utils.h"
 #include <JuceHeader.h>
 #include <cassert>
@@ -15,10 +17,8 @@ public:
 
     Reader(const Reader &&) = delete;
 
-    explicit Reader(std::queue<float> *bufferIn, CriticalSection *lockInput, std::queue<FrameType> *bufferOut,
-                    CriticalSection *lockOutput)
-            : Thread("Reader"), input(bufferIn), output(bufferOut), protectInput(lockInput),
-              protectOutput(lockOutput) {
+    explicit Reader(SampleRing *bufferIn, std::queue<FrameType> *bufferOut, CriticalSection *lockOutput)
+            : Thread("Reader"), input(bufferIn), output(bufferOut), protectOutput(lockOutput) {
         fprintf(stderr, "    Reader Thread Start\n");
     }
 
@@ -27,20 +27,13 @@ public:
     void run() override {
         assert(input != nullptr);
         assert(output != nullptr);
-        assert(protectInput != nullptr);
         assert(protectOutput != nullptr);
         auto readBool = [this]() {
             auto temp = 0;
             auto avg = 0.0f;
             while (!threadShouldExit()) {
-                protectInput->enter();
-                if (input->empty()) {
-                    protectInput->exit();
-                    continue;
-                }
-                float nextValue = input->front();
-                input->pop();
-                protectInput->exit();
+                float nextValue;
+                if (!input->pop(nextValue)) continue;
                 // Divide here - in case we have a complex float-to-bool method
                 avg += nextValue / LENGTH_OF_ONE_BIT;
                 ++temp;
@@ -61,14 +54,8 @@ public:
         auto waitForPreamble = [this]() {// sync[i] = Σ signal[i : i + LENGTH_OF_ONE_BIT]
             auto sync = std::deque<float>(LENGTH_PREAMBLE * LENGTH_OF_ONE_BIT, 0);
             while (!threadShouldExit()) {
-                protectInput->enter();
-                if (input->empty()) {
-                    protectInput->exit();
-                    continue;
-                }
-                float nextValue = input->front();
-                input->pop();
-                protectInput->exit();
+                float nextValue;
+                if (!input->pop(nextValue)) continue;
                 sync.pop_front();
                 sync.push_back(nextValue);
                 for (int i = 1; i < LENGTH_OF_ONE_BIT; ++i) *(sync.rbegin() + i) += nextValue;
@@ -81,41 +68,41 @@ public:
                 if (isPreamble) return;
             }
         };
+        trace::nameThread("Reader");
         while (!threadShouldExit()) {
             // wait for PREAMBLE
             waitForPreamble();
             if (threadShouldExit()) break;
-            protectInput->enter();
-            if (!input->empty()) input->pop();
-            protectInput->exit();
+            TRACE(trace::Event::PreambleDetected);
+            float skipped;
+            input->pop(skipped);
             // read LEN, SEQ
             int numLEN = readShort();
             int numSEQ = readShort();
             if (numLEN > MAX_LENGTH_BODY) {
                 // Too long! There must be some errors.
-                fprintf(stderr, "    Discarded due to wrong length. len = %d, seq = %d\n", numLEN, numSEQ);
+                TRACE(trace::Event::DiscardLength, numLEN, numSEQ);
                 continue;
             }
             // read BODY
             FrameType frame(numLEN, numSEQ);
-            for (int i = 0; i < numLEN; ++i) frame.frame[i] = readBool();
+            for (int i = 0; i < numLEN; ++i) frame.frame.set(i, readBool());
             // read CRC
             unsigned int numCRC = readInt();
             if (frame.crc() != numCRC) {
-                fprintf(stderr, "    Discarded due to failing CRC check. len = %d, seq = %d\n", numLEN, numSEQ);
+                TRACE(trace::Event::DiscardCRC, numLEN, numSEQ);
                 continue;
             }
             protectOutput->enter();
             output->push(frame);
             protectOutput->exit();
-            fprintf(stderr, "    SUCCEED! len = %d, seq = %d\n", numLEN, numSEQ);
+            TRACE(trace::Event::FrameDelivered, numLEN, numSEQ);
         }
     }
 
 private:
-    std::queue<float> *input{nullptr};
+    SampleRing *input{nullptr};
     std::queue<FrameType> *output{nullptr};
-    CriticalSection *protectInput;
     CriticalSection *protectOutput;
 };
 
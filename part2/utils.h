@@ -1,9 +1,11 @@
 #pragma once
 
+#include "bitstream.h"
 #include <algorithm>
 #include <boost/crc.hpp>
 #include <chrono>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 #define LENGTH_OF_ONE_BIT 4// Must be a number in 1/2/3/4/5/6/8/10
@@ -39,13 +41,13 @@ public:
 
     FrameType(size_t sizeOfFrame, int numSEQ);
 
-    FrameType(std::vector<bool> &value, int numSEQ) : frame(value), seq(numSEQ) {}
+    FrameType(BitStream value, int numSEQ) : frame(std::move(value)), seq(numSEQ) {}
 
     [[nodiscard]] unsigned int crc() const;
 
     [[nodiscard]] size_t size() const;
 
-    std::vector<bool> frame;
+    BitStream frame;
     int seq;
 };
 
@@ -71,5 +73,3 @@ struct FrameWaitingInfo {
     double waitingTime = 0;
     int resendTimes = 3;
 };
-
-unsigned int crc(const std::vector<bool> &source);
@@ -1,6 +1,8 @@
 #ifndef WRITER_H
 #define WRITER_H
 
+#include "ring.h"
+#include "trace.h"
 #include "utils.h"
 #include <JuceHeader.h>
 #include <cassert>
@@ -15,46 +17,51 @@ public:
 
     Writer(const Writer &&) = delete;
 
-    explicit Writer(std::queue<float> *bufferOut, CriticalSection *lockOutput) :
-            output(bufferOut), protectOutput(lockOutput) {}
+    // sampleRate is the device's, for the waiting time send() estimates
+    explicit Writer(SampleRing *bufferOut, double sampleRate = 48000) : output(bufferOut), rate(sampleRate) {}
 
     void writeBool(bool bit) {
-        for (int i = 0; i < LENGTH_OF_ONE_BIT; ++i) { output->push(bit ? 1.0f : 0.0f); }
+        for (int i = 0; i < LENGTH_OF_ONE_BIT; ++i) {
+            while (!output->push(bit ? 1.0f : 0.0f)) Thread::yield();
+        }
     };
 
-    void writeShort(short x) {
-        for (int i = 0; i < 16; ++i) { writeBool((bool) (x >> i & 1)); }
-    };
+    // The low n bits of x, LSB first
+    void writeBits(uint64_t x, unsigned n) {
+        for (unsigned i = 0; i < n; ++i) { writeBool((bool) (x >> i & 1)); }
+    }
 
-    void writeInt(int x) {
-        for (int i = 0; i < 32; ++i) { writeBool((bool) (x >> i & 1)); }
-    };
+    void writeShort(short x) { writeBits((uint16_t) x, 16); };
+
+    void writeInt(int x) { writeBits((uint32_t) x, 32); };
 
     // Send a frame, return estimated waiting time
     double send(const FrameType &frame) {
-        protectOutput->enter();
-        while (!output->empty()) {
-            protectOutput->exit();
-            protectOutput->enter();
-        }
+        protectOutput.enter();
+        while (!output->empty()) Thread::yield();
         // PREAMBLE
         for (auto b: preamble) { writeBool(b); }
         // LEN
         writeShort((short) frame.size());
         // SEQ
         writeShort((short) frame.seq);
-        // BODY
-        for (auto b: frame.frame) { writeBool(b); }
+        // BODY, a word at a time
+        for (BitCursor body(frame.frame); body.left() > 0;) {
+            auto n = (unsigned) std::min<size_t>(64, body.left());
+            writeBits(body.take(n), n);
+        }
         // CRC
         writeInt((int) frame.crc());
-        double waitingTime = (double) output->size() / 48000.0;
-        protectOutput->exit();
+        double waitingTime = (double) output->size() / rate;
+        TRACE(trace::Event::WriterQueued, (int32_t) frame.size(), frame.seq, (int32_t) output->size());
+        protectOutput.exit();
         return waitingTime;
     }
 
 private:
-    std::queue<float> *output{nullptr};
-    CriticalSection *protectOutput;
+    SampleRing *output{nullptr};
+    double rate;
+    CriticalSection protectOutput; // orders senders, the audio callback never takes it
 };
 
 #endif//WRITER_H
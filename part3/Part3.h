@@ -1,7 +1,9 @@
-#include "reader.h"
+#include "audio_block.h"
+#include "capture.h"
 #include "utils.h"
-#include "writer.h"
 #include <JuceHeader.h>
+#include <array>
+#include <cstdlib>
 #include <fstream>
 #include <queue>
 #include <thread>
@@ -14,6 +16,7 @@ class MainContentComponent : public juce::AudioAppComponent {
 public:
     MainContentComponent() {
         static auto MacLayer = [this](bool isNode1) {
+            if (link == nullptr) return;
             // Transmission Initialization
             std::ifstream fIn("INPUT.bin", std::ios::binary | std::ios::in);
             if (fIn.is_open()) {
@@ -24,103 +27,12 @@ public:
             }
             std::string data;
             for (char c; fIn.get(c);) { data.push_back(c); }
-            size_t dataLength = data.size();
-            // frameList[0] is used to store the number of frames
-            std::vector<FrameType> frameListSent(1);
-            std::map<unsigned, FrameType> frameListRec;
-            std::vector<FrameWaitingInfo> info;
-            for (unsigned i = 0; i * MAX_LENGTH_BODY < dataLength; ++i) {
-                auto len = (LENType) std::min(MAX_LENGTH_BODY, dataLength - i * MAX_LENGTH_BODY);
-                auto seq = (SEQType) ((signed) (i + 2) * (isNode1 ? 1 : -1));
-                frameListSent.emplace_back(FrameType(len, seq, data.c_str() + i * MAX_LENGTH_BODY));
-            }
-            auto frameNumSent = (SEQType) frameListSent.size();
-            frameListSent[0] = FrameType((LENType) LENGTH_SEQ, (SEQType) (isNode1 ? 1 : -1), &frameNumSent);
-            // Node2 waits for Node1 to tell it start
-            if (!isNode1) {
-                while (true) {
-                    binaryInputLock.enter();
-                    if (!binaryInput.empty()) break;
-                    binaryInputLock.exit();
-                }
-                binaryInputLock.exit();
-            }
-            MyTimer testTotalTime;
-            unsigned LAR = 0, LFS = 0, LFR = 0;
-            bool ACKedAll = false, receiveAll = false;
-            while (!ACKedAll || !receiveAll) {
-                // try to receive a frame or an ACK
-                while (true) {
-                    binaryInputLock.enter();
-                    if (binaryInput.empty()) {
-                        binaryInputLock.exit();
-                        break;
-                    }
-                    FrameType frame = binaryInput.front();
-                    binaryInput.pop();
-                    binaryInputLock.exit();
-                    auto seqNum = (unsigned) abs(frame.seq);
-                    // It's a frame
-                    if (frame.len != 0) {
-                        // ignore self sent
-                        if (isNode1 ? frame.seq > 0 : frame.seq < 0)
-                            continue;
-                        fprintf(stderr, "frame received, seq = %d\n", frame.seq);
-                        // Accept this frame and update LFR
-                        frameListRec[seqNum] = frame;
-                        while (frameListRec.find(LFR + 1) != frameListRec.end()) ++LFR;
-                        // send ACK
-                        writer->send(FrameType(0, frame.seq, nullptr));
-                        fprintf(stderr, "ACK sent, seq = %d\n", frame.seq);
-                        // every frame from the other Node is received
-                        if (!receiveAll && LFR == (unsigned) *(SEQType *) &frameListRec[1].body) {
-                            receiveAll = true;
-                            fprintf(stderr, "------- All frames received in %lfs --------\n", testTotalTime.duration());
-                            std::ofstream fOut("OUTPUT.bin", std::ios::binary | std::ios::out);
-                            for (auto iter: frameListRec) {
-                                if (iter.first == 1) continue;
-                                for (unsigned i = 0; i < iter.second.len; ++i)
-                                    fOut.put(iter.second.body[i]);
-                            }
-                        }
-                    } else { // It's an ACK
-                        if (LAR < seqNum && seqNum <= LFS) {
-                            info[LFS - seqNum].receiveACK = true;
-                            fprintf(stderr, "ACK %d received after %lfs, resendTimes left %d\n", frame.seq,
-                                    info[LFS - seqNum].timer.duration(), info[LFS - seqNum].resendTimes);
-                        }
-                    }
-                }
-                // update LAR
-                while (LAR < LFS && info.rbegin()->receiveACK) {
-                    ++LAR;
-                    info.pop_back();
-                    // every frame to the other Node is ACKed
-                    if (!ACKedAll && LAR == (unsigned) frameNumSent)
-                        ACKedAll = true;
-                }
-                // resend timeout frames
-                for (unsigned seq = LAR + 1; seq <= LFS; ++seq) {
-                    if (info[LFS - seq].receiveACK ||
-                        info[LFS - seq].timer.duration() < (isNode1 ? SLIDING_WINDOW_TIMEOUT_NODE1
-                                                                    : SLIDING_WINDOW_TIMEOUT_NODE2))
-                        continue;
-                    if (info[LFS - seq].resendTimes == 0) {
-                        fprintf(stderr, "Link error detected! frame seq = %d resend too many times...\n", seq);
-                        return;
-                    }
-                    writer->send(frameListSent[seq - 1]);
-                    fprintf(stderr, "Oh No Frame Resent!, seq = %d\n", frameListSent[seq - 1].seq);
-                    info[LFS - seq].timer.restart();
-                    info[LFS - seq].resendTimes--;
-                }
-                // try to update LFS and send a frame
-                if (LFS - LAR < SLIDING_WINDOW_SIZE && LFS < (unsigned) frameNumSent) {
-                    ++LFS;
-                    writer->send(frameListSent[LFS - 1]);
-                    info.insert(info.begin(), FrameWaitingInfo());
-                    fprintf(stderr, "Frame sent, seq = %d\n", LFS);
-                }
+            auto result = link->transfer(isNode1, data, RESEND_TIMES);
+            if (result.receiveAll) {
+                fprintf(stderr, "------- All frames received in %lfs (%.0f bps, %zu bytes on air) --------\n",
+                        result.receiveSeconds, result.goodput(), result.receivedOnAir);
+                std::ofstream fOut("OUTPUT.bin", std::ios::binary | std::ios::out);
+                fOut.write(result.received.c_str(), (std::streamsize) result.received.size());
             }
         };
 
@@ -144,20 +56,63 @@ public:
         addAndMakeVisible(Node2Button);
 
         setSize(600, 300);
-        setAudioChannels(1, 1);
+        setAudioChannels(MAX_LANES, MAX_LANES);
+        // The sound card runs at the rate of the link unless PROJECT2_DEVICE_RATE=96000 (or 192000)
+        // says otherwise; the audio blocks resample between the two if they differ
+        auto linkName = getenv("PROJECT2_LINK"), deviceRate = getenv("PROJECT2_DEVICE_RATE");
+        auto rate = deviceRate ? atof(deviceRate) : (double) linkSampleRate(linkName ? linkName : "default");
+        AudioDeviceManager::AudioDeviceSetup setup;
+        deviceManager.getAudioDeviceSetup(setup);
+        if (rate > 0 && std::lround(setup.sampleRate) != std::lround(rate)) {
+            setup.sampleRate = rate;
+            auto error = deviceManager.setAudioDeviceSetup(setup, true);
+            if (error.isNotEmpty())
+                fprintf(stderr, "failed to run the device at %.0f Hz: %s\n", rate, error.toRawUTF8());
+        }
     }
 
     ~MainContentComponent() override { shutdownAudio(); }
 
 private:
     void initThreads() {
-        reader = new Reader(&directInput, &directInputLock, &binaryInput, &binaryInputLock);
-        reader->startThread();
-        writer = new Writer(&directOutput, &directOutputLock, &quiet);
+        if (!trace::start("trace.bin")) fprintf(stderr, "failed to open trace.bin!\n");
+        if (!statsExporter.start(&stats, "stats.csv")) fprintf(stderr, "failed to open stats.csv!\n");
+        // Set PROJECT2_MAC=tdma or tdma-demand to transfer in TDMA slots instead of CSMA
+        auto macName = getenv("PROJECT2_MAC");
+        auto mode = MacMode::Csma;
+        if (macName && !parseMacMode(macName, mode))
+            fprintf(stderr, "unknown MAC %s, use one of: %s\n", macName, MAC_MODE_NAMES);
+        // Set PROJECT2_LANES=2 to stripe frames over both channels of a stereo cable
+        auto lanesName = getenv("PROJECT2_LANES");
+        lanes = std::min(lanesName ? (unsigned) std::max(atoi(lanesName), 1) : 1u, channels.lanes());
+        LinkIO io{directInput.data(), directOutput.data(), quiet.data(), &stats, lanes};
+        // Set PROJECT2_LINK=<name> to pick another compiled-in configuration
+        auto linkName = getenv("PROJECT2_LINK");
+        link = makeLink(linkName ? linkName : "default", io, mode);
+        if (link == nullptr) {
+            fprintf(stderr, "unknown link configuration %s, use one of: %s\n", linkName, LINK_CONFIG_NAMES);
+            link = makeLink("default", io, mode);
+        }
+        for (auto &block: audioBlocks) block.configure(link->carrierSense());
+        // Set PROJECT2_COMPRESS=0 to send the data as it is
+        if (auto compress = getenv("PROJECT2_COMPRESS")) link->setCompression(std::string(compress) != "0");
     }
 
-    void prepareToPlay([[maybe_unused]] int samplesPerBlockExpected, [[maybe_unused]] double sampleRate) override {
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override {
+        channels.update(deviceManager.getCurrentAudioDevice());
         initThreads();
+        if (!carriesAt(*link, sampleRate)) {
+            fprintf(stderr, "!!! the link at %.0f Hz does not survive resampling to the device at %.0f Hz, "
+                            "refusing to run it; open the device faster with PROJECT2_DEVICE_RATE\n",
+                    link->sampleRate(), sampleRate);
+            link.reset();
+            return;
+        }
+        for (auto &block: audioBlocks) block.setRates(sampleRate, link->sampleRate(), samplesPerBlockExpected);
+        // Set PROJECT2_CAPTURE=<file> to record the input, at the link rate, for Project2_Replay
+        if (auto path = getenv("PROJECT2_CAPTURE")) {
+            if (!capture.start(path, link->sampleRate())) fprintf(stderr, "failed to open %s!\n", path);
+        }
         AudioDeviceManager::AudioDeviceSetup currentAudioSetup;
         deviceManager.getAudioDeviceSetup(currentAudioSetup);
         currentAudioSetup.bufferSize = 144; // 144 160 192
@@ -166,80 +121,51 @@ private:
     }
 
     void getNextAudioBlock(const juce::AudioSourceChannelInfo &bufferToFill) override {
-        auto *device = deviceManager.getCurrentAudioDevice();
-        auto activeInputChannels = device->getActiveInputChannels();
-        auto activeOutputChannels = device->getActiveOutputChannels();
-        auto maxInputChannels = activeInputChannels.getHighestBit() + 1;
-        auto maxOutputChannels = activeOutputChannels.getHighestBit() + 1;
         auto buffer = bufferToFill.buffer;
         auto bufferSize = buffer->getNumSamples();
-        for (auto channel = 0; channel < maxOutputChannels; ++channel) {
-            if ((!activeInputChannels[channel] || !activeOutputChannels[channel]) || maxInputChannels == 0) {
+        unsigned lane = 0;
+        for (auto channel = 0; channel < channels.numOutputs; ++channel) {
+            // lane i of the link runs on the i-th channel that has both input and output
+            if (lane == lanes || !channels.isLinked(channel)) {
                 bufferToFill.buffer->clear(channel, bufferToFill.startSample, bufferToFill.numSamples);
             } else {
-                // Read in PHY layer
-                const float *data = buffer->getReadPointer(channel);
-                directInputLock.enter();
-                for (int i = 0; i < bufferSize; ++i) { directInput.push(data[i]); }
-                directInputLock.exit();
-                // listen if the channel is quiet
-                bool nowQuiet = true;
-                for (int i = bufferSize - LENGTH_PREAMBLE * LENGTH_OF_ONE_BIT; i < bufferSize; ++i)
-                    if (fabs(data[i]) > NOISY_THRESHOLD) {
-                        nowQuiet = false;
-//                        fprintf(stderr, "\t\tNoisy Now!!!!\n");
-//                        std::ofstream logOut("log.out", std::ios::app);
-//                        for (int j = 0; j < bufferSize; ++j)logOut << (int) (data[j] * 100) << ' ';
-//                        logOut << "\n";
-//                        logOut.close();
-                        break;
-                    }
-                quiet.set(nowQuiet);
-                buffer->clear();
-                // Write if PHY layer wants
-                float *writePosition = buffer->getWritePointer(channel);
-                for (int i = 0; i < bufferSize; ++i)
-                    writePosition[i] = 0.0f;
-//                constexpr int W = 2;
-//                constexpr int bits[16] = {1,1,1,1,0,1,1,1,
-//                                          1,1,1,1,0,1,1,1};
-//                for (int i = 0; i < 16; ++i) {
-//                    writePosition[4 * i + 0] = writePosition[4 * i + 1] = bits[i] ? 1.0f : -1.0f;
-//                    writePosition[4 * i + 2] = writePosition[4 * i + 3] = bits[i] ? -1.0f : 1.0f;
-//                }
-                directOutputLock.enter();
-                for (int i = 0; i < bufferSize; ++i) {
-                    if (directOutput.empty()) {
-                        directOutputLock.exit();
-                        directOutputLock.enter();
-                        continue;
-                    }
-                    writePosition[i] = directOutput.front();
-                    directOutput.pop();
-                }
-                directOutputLock.exit();
+                audioBlocks[lane++].process(buffer->getWritePointer(channel), bufferSize);
             }
         }
     }
 
     void releaseResources() override {
-        delete reader;
-        delete writer;
+        link.reset();
+        if (!rtcheck::report(stderr)) fprintf(stderr, "the audio callback allocated or locked!\n");
+        statsExporter.stop();
+        if (!stats.latency.save("latency.csv")) fprintf(stderr, "failed to open latency.csv!\n");
+        capture.stop();
+        trace::stop();
     }
 
 private:
-    // Process Input
-    Reader *reader{nullptr};
-    std::queue<float> directInput;
-    CriticalSection directInputLock;
-    std::queue<FrameType> binaryInput;
-    CriticalSection binaryInputLock;
+    // PHY and MAC
+    std::unique_ptr<Link> link;
+
+    // Process Input, one ring per lane
+    std::array<SampleRing, MAX_LANES> directInput;
 
     // Process Output
-    Writer *writer{nullptr};
-    std::queue<float> directOutput;
-    CriticalSection directOutputLock;
-    Atomic<bool> quiet = false;
+    std::array<OutputScheduler, MAX_LANES> directOutput;
+    std::array<Atomic<bool>, MAX_LANES> quiet;
+
+    // Instrumentation
+    LinkStats stats;
+    StatsExporter statsExporter;
+    AudioCapture capture;      // the first lane
+    AudioCapture unrecorded;   // never started, push() returns at once
+
+    // Audio callback, touches nothing but the rings and atomics above
+    ChannelLayout channels;
+    unsigned lanes{1};
+    static_assert(MAX_LANES == 2, "one LinkAudioBlock per lane");
+    LinkAudioBlock audioBlocks[MAX_LANES]{{directInput[0], directOutput[0], quiet[0], stats, capture},
+                                          {directInput[1], directOutput[1], quiet[1], stats, unrecorded}};
 
     // GUI related
     juce::Label titleLabel;
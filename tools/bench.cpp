@@ -0,0 +1,238 @@
+#include "bench.h"
+#include "dsp.h"
+#include "frame.h"
+#include "link_config.h"
+#include "lz.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "reader.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <fstream>
+#include <random>
+
+/* Microbenchmarks for the PHY and framing primitives of Part3 - Part5, the filters in dsp.h, the LZ codec and Part1's DSP helpers
+ *
+ * usage: Project2_Bench [payload file] [link configuration]
+ * The payload defaults to INPUT.bin if it exists, otherwise 4 KiB from a fixed-seed generator.
+ * The link configuration defaults to "default", see link_config.h.
+ * Recorded samples are produced by Writer::send for that payload, so every commit sees the same input.
+ * The filters of dsp.h run over a fixed signal in blocks of 512 samples, like an audio callback would.
+ */
+
+namespace {
+
+std::string loadPayload(const char *path) {
+    std::ifstream fIn(path, std::ios::binary | std::ios::in);
+    std::string ret;
+    for (char c; fIn.get(c);) ret.push_back(c);
+    if (!ret.empty()) return ret;
+    std::mt19937 rng(2022);
+    for (int i = 0; i < 4096; ++i) ret.push_back((char) (rng() & 0xff));
+    return ret;
+}
+
+template<class Config>
+std::vector<FrameType<Config>> makeFrames(const std::string &payload) {
+    constexpr size_t body = Config::MAX_LENGTH_BODY;
+    std::vector<FrameType<Config>> ret;
+    for (size_t i = 0; i * body < payload.size(); ++i) {
+        auto len = (typename Config::LENType) std::min(body, payload.size() - i * body);
+        ret.emplace_back(len, (typename Config::SEQType) (i % 127 + 1), payload.c_str() + i * body);
+    }
+    return ret;
+}
+
+template<class Config>
+void benchLink(const std::string &payload) {
+    constexpr size_t L = Config::LENGTH_OF_ONE_BIT;
+    auto frames = makeFrames<Config>(payload);
+    fprintf(stderr, "payload %zu bytes, %zu frames\n", payload.size(), frames.size());
+
+    OutputScheduler samples;
+    SampleRing input;
+    FramePool<Config> pool;
+    FrameQueue<Config> output(pool);
+    Atomic<bool> quiet = true;
+    LinkStats stats;
+    Writer<Config> writer(&samples, &quiet, &stats);
+    Reader<Config> reader(&input, &output, &stats); // never started, driven directly
+    // Only valid while no thread consumes the ring
+    std::vector<float> scratch(SampleRing::capacity());
+    auto clear = [&scratch](SampleRing &ring) { ring.pop(scratch.data(), scratch.size()); };
+    auto fill = [](SampleRing &ring, const float *data, size_t n) { ring.push(data, n); };
+
+    // Writer::send sample generation, playing it out again is part of the cost
+    size_t frameIndex = 0;
+    auto play = [&scratch](OutputScheduler &output) {
+        return output.render(scratch.data(), output.backlog()).transmitted;
+    };
+    bench::run("Writer::send", "sample", [&] { play(samples); }, [&] {
+        writer.send(frames[frameIndex++ % frames.size()]);
+        return play(samples);
+    });
+
+    // The recorded waveform of the whole payload, reused by the receive side benchmarks
+    std::vector<float> recorded;
+    for (auto &frame: frames) {
+        writer.send(frame);
+        auto n = play(samples);
+        recorded.insert(recorded.end(), scratch.begin(), scratch.begin() + (long) n);
+    }
+
+    // at the level of a full-scale preamble
+    bench::run("judgeBit", "bit", [] {}, [&] {
+        int ones = 0;
+        auto threshold = sliceThreshold<Config>(2.0f);
+        for (size_t i = 0; i + L / 2 < recorded.size(); i += L)
+            ones += judgeBit(recorded[i], recorded[i + L / 2], threshold);
+        bench::consume(ones);
+        return recorded.size() / L;
+    });
+
+    // readByte on the recorded frames, sliced at the level of the first preamble like the real path;
+    // queued twice so a resync can never run dry
+    bench::run("Reader::readByte", "byte", [&] {
+        clear(input);
+        for (int copy = 0; copy < 2; ++copy) fill(input, recorded.data(), recorded.size());
+        reader.waitForPreamble();
+    }, [&] {
+        size_t bytes = recorded.size() / L / 8;
+        char sum = 0;
+        for (size_t i = 0; i < bytes; ++i) sum = (char) (sum + reader.readByte());
+        bench::consume(sum);
+        return bytes;
+    });
+
+    // waitForPreamble scanning synthetic noise followed by one recorded frame
+    std::vector<float> noise(48000);
+    std::mt19937 rng(2022);
+    std::uniform_real_distribution<float> uniform(-0.2f, 0.2f);
+    for (auto &sample: noise) sample = uniform(rng);
+    bench::run("Reader::waitForPreamble", "sample", [&] {
+        clear(input);
+        fill(input, noise.data(), noise.size());
+        fill(input, recorded.data(), Config::PREAMBLE_SAMPLES);
+    }, [&] {
+        reader.waitForPreamble();
+        return noise.size() + Config::PREAMBLE_SAMPLES;
+    });
+
+    // The whole receive path, single-threaded and pipelined, from input samples to delivered frames;
+    // a batch gives up on frames that are not delivered within RECEIVE_TIMEOUT
+    auto receive = [&](const char *name, auto &receiver) {
+        constexpr auto RECEIVE_TIMEOUT = std::chrono::seconds(10);
+        clear(input);
+        for (FrameHandle<Config> frame; output.pop(frame);) {}
+        receiver.startThread();
+        size_t fewest = frames.size();
+        bench::run(name, "sample", [] {}, [&] {
+            size_t delivered = 0;
+            auto take = [&] {
+                for (FrameHandle<Config> frame; output.pop(frame);) ++delivered;
+            };
+            for (size_t pushed = 0; (pushed += input.push(recorded.data() + pushed, recorded.size() - pushed)) <
+                                    recorded.size(); take())
+                Thread::yield();
+            auto deadline = std::chrono::steady_clock::now() + RECEIVE_TIMEOUT;
+            for (; delivered < frames.size() && std::chrono::steady_clock::now() < deadline; Thread::yield()) take();
+            fewest = std::min(fewest, delivered);
+            return recorded.size();
+        });
+        receiver.stopThread(1000);
+        if (fewest < frames.size())
+            fprintf(stderr, "%s delivered only %zu of %zu frames in a batch, its figure is not comparable\n", name,
+                    fewest, frames.size());
+    };
+    Reader<Config> threadedReader(&input, &output, &stats);
+    receive("Reader::run", threadedReader);
+    ReceivePipeline<Config> pipeline(&input, &output, &stats);
+    receive("ReceivePipeline", pipeline);
+
+    bench::run("FrameType::wholeString", "byte", [] {}, [&] {
+        size_t bytes = 0;
+        for (auto &frame: frames) {
+            auto str = frame.wholeString();
+            bench::consume(str);
+            bytes += str.size();
+        }
+        return bytes;
+    });
+
+    // per byte the CRC covers, which is wholeString() of the frame
+    size_t crcBytes = 0;
+    for (auto &frame: frames) crcBytes += frame.wholeString().size();
+    bench::run("FrameType::crc", "byte", [] {}, [&] {
+        unsigned sum = 0;
+        for (auto &frame: frames) sum += frame.crc();
+        bench::consume(sum);
+        return crcBytes;
+    });
+}
+
+template<class Filter>
+void benchFilter(const std::string &name, const std::vector<float> &signal, Filter filter) {
+    constexpr size_t BLOCK = 512;
+    std::vector<float> work;
+    bench::run(name, "sample", [&] { work = signal; }, [&] {
+        for (size_t i = 0; i < work.size(); i += BLOCK) filter.process(work.data() + i, std::min(BLOCK, work.size() - i));
+        bench::consume(work);
+        return work.size();
+    });
+}
+
+void benchDsp() {
+    std::vector<float> signal(48000);
+    for (size_t i = 0; i < signal.size(); ++i) signal[i] = sinf((float) i * 0.3f) + ((i * 7919) % 13) * 0.01f;
+    for (size_t span: {5, 25, 101}) benchFilter("dsp::MovingAverage/" + std::to_string(span), signal, dsp::MovingAverage(span));
+    for (size_t taps: {16, 64, 240}) {
+        std::vector<float> coefficients(taps);
+        for (size_t i = 0; i < taps; ++i) coefficients[i] = sinf((float) i * 0.7f) / (float) taps;
+        benchFilter("dsp::Fir/" + std::to_string(taps), signal, dsp::Fir(coefficients));
+    }
+    benchFilter("dsp::Biquad", signal, dsp::Biquad(dsp::Biquad::lowPass(48000, 4000)));
+    benchFilter("dsp::DcBlocker", signal, dsp::DcBlocker());
+    benchFilter("dsp::Integrator", signal, dsp::Integrator(1.0 / 48000));
+    // per input sample, between the link and a device at another rate
+    for (unsigned rate: {44100, 96000, 192000}) {
+        dsp::Resampler resampler(48000, rate);
+        std::vector<float> out(resampler.outputsFor(signal.size()));
+        bench::run("dsp::Resampler/48000-" + std::to_string(rate), "sample", [&] { resampler.reset(); }, [&] {
+            bench::consume(resampler.process(signal.data(), signal.size(), out.data()));
+            return signal.size();
+        });
+    }
+}
+
+// The payload compression of Link::transfer(), per original byte
+void benchLz(const std::string &payload) {
+    auto packed = lzCompress(payload.data(), payload.size());
+    fprintf(stderr, "lz: %zu -> %zu bytes\n", payload.size(), packed.size());
+    bench::run("lzCompress", "byte", [] {}, [&] {
+        bench::consume(lzCompress(payload.data(), payload.size()));
+        return payload.size();
+    });
+    std::string output;
+    output.reserve(payload.size());
+    bench::run("LzDecoder::feed", "byte", [&] { output.clear(); }, [&] {
+        LzDecoder decoder(output);
+        decoder.feed(packed.data(), packed.size());
+        bench::consume(output);
+        return payload.size();
+    });
+}
+
+}// namespace
+
+int main(int argc, char **argv) {
+    auto payload = loadPayload(argc > 1 ? argv[1] : "INPUT.bin");
+    bench::header();
+    if (!withLinkConfig(argc > 2 ? argv[2] : "default", [&](auto config) { benchLink<decltype(config)>(payload); })) {
+        fprintf(stderr, "unknown link configuration %s, use one of: %s\n", argv[2], LINK_CONFIG_NAMES);
+        return 1;
+    }
+    benchDsp();
+    benchLz(payload);
+    benchPart1(payload);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* Tiny benchmark harness
+ *
+ * Every benchmark runs its body until at least MIN_MILLIS have passed, five times, and reports the
+ * fastest run in nanoseconds per unit (sample, bit or byte). Setup is excluded from the timing.
+ * Output is CSV so runs from different commits can be diffed or plotted directly.
+ */
+
+namespace bench {
+
+constexpr int MIN_MILLIS = 100;
+constexpr int REPEATS = 5;
+
+// Keeps the optimizer from discarding results
+template<class T>
+inline void consume(const T &value) {
+#if defined(_MSC_VER)
+    static const void *volatile sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "g"(&value) : "memory");
+#endif
+}
+
+inline void header() { printf("benchmark,unit,ns_per_unit,units_per_second\n"); }
+
+// setup() prepares one batch and returns nothing; body() processes it and returns the number of units
+template<class Setup, class Body>
+void run(const std::string &name, const std::string &unit, Setup &&setup, Body &&body) {
+    double best = 1e300;
+    for (int repeat = 0; repeat < REPEATS; ++repeat) {
+        double elapsed = 0, units = 0;
+        while (elapsed < MIN_MILLIS * 1e6) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            units += (double) body();
+            elapsed += (double) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+        best = std::min(best, elapsed / units);
+    }
+    printf("%s,%s,%.3f,%.0f\n", name.c_str(), unit.c_str(), best, 1e9 / best);
+    fflush(stdout);
+}
+
+}// namespace bench
+
+// Defined in bench_part1.cpp, which sees Part1's macros instead of Part3's
+void benchPart1(const std::string &payload);
@@ -0,0 +1,38 @@
+#include "../part1/utils.h"
+#include "bench.h"
+
+void benchPart1(const std::string &payload) {
+    BitStream bits;
+    for (auto c: payload) bits.write(BitStream::reverse((uint8_t) c), 8);
+
+    bench::run("part1.linspace", "sample", [] {}, [] {
+        auto ret = linspace(2000, 10000, 4800);
+        bench::consume(ret);
+        return ret.size();
+    });
+
+    std::vector<float> t, f;
+    for (int i = 0; i < 4800; ++i) t.push_back((float) i / 48000.0f);
+    f = linspace(2000, 10000, 4800);
+    bench::run("part1.cumtrapz", "sample", [] {}, [&] {
+        auto ret = cumtrapz(t, f);
+        bench::consume(ret);
+        return ret.size();
+    });
+
+    std::vector<float> signal(4800);
+    for (size_t i = 0; i < signal.size(); ++i) signal[i] = sinf((float) i * 0.3f) + ((i * 7919) % 13) * 0.01f;
+    for (size_t span: {5, 25, 101}) {
+        bench::run("part1.smooth/" + std::to_string(span), "sample", [] {}, [&] {
+            auto ret = smooth(signal, span);
+            bench::consume(ret);
+            return ret.size();
+        });
+    }
+
+    bench::run("part1.crc", "byte", [] {}, [&] {
+        auto ret = crc(bits);
+        bench::consume(ret);
+        return bits.size() / 8;
+    });
+}
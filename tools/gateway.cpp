@@ -0,0 +1,138 @@
+#include "gateway.h"
+#include "link.h"
+#include "loopback.h"
+#include <JuceHeader.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <iostream>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* UDP gateway over the in-process cable, both nodes in one process
+ *
+ * usage: Project2_Gateway [link configuration] [node1 listen] [node1 forward] [node2 listen] [node2 forward]
+ *        Project2_Gateway selftest [link configuration] [datagrams]
+ * The first form bridges until stdin closes; by default datagrams sent to 127.0.0.1:9000 come out
+ * at 127.0.0.1:9002, and what is sent back to where they came from (9001) returns to the sender:
+ *   nc -u -l 9002    and    nc -u 127.0.0.1 9000
+ * The self test sends datagrams of every size up to a few frames through both gateways and has
+ * them echoed back; it exits with 1 unless all of them came back in order and intact.
+ */
+
+namespace {
+
+struct GatewayNode : LoopbackNode {
+    std::unique_ptr<UdpGateway> gateway;
+
+    bool open(const std::string &config, bool isNode1, uint16_t listen, uint16_t forward) {
+        if (!LoopbackNode::open(config, MacMode::Csma)) return false;
+        gateway = std::make_unique<UdpGateway>(link->connect(isNode1, 20), listen, forward);
+        if (gateway->start()) return true;
+        fprintf(stderr, "cannot bind 127.0.0.1:%u\n", listen);
+        return false;
+    }
+};
+
+// A UDP socket on an ephemeral localhost port that gives up receiving after timeoutSeconds
+int openUdp(double timeoutSeconds, uint16_t &port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bind(fd, (const sockaddr *) &address, sizeof(address));
+    getsockname(fd, (sockaddr *) &address, &length);
+    port = ntohs(address.sin_port);
+    timeval timeout{(time_t) timeoutSeconds, (suseconds_t) ((timeoutSeconds - (int) timeoutSeconds) * 1e6)};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+void sendTo(int fd, const std::string &data, uint16_t port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    sendto(fd, data.data(), data.size(), 0, (const sockaddr *) &address, sizeof(address));
+}
+
+int selfTest(const std::string &config, int count) {
+    constexpr double TIMEOUT = 30;
+    uint16_t clientPort, serverPort;
+    int client = openUdp(TIMEOUT, clientPort), server = openUdp(TIMEOUT, serverPort);
+    GatewayNode node1, node2;
+    if (!node1.open(config, true, 0, 0) || !node2.open(config, false, 0, serverPort)) return 1;
+    LoopbackCable cable(node1, node2);
+
+    std::mt19937 rng(43);
+    std::vector<std::string> datagrams(count);
+    auto maxSize = 3 * node1.link->maxBodyLength();
+    for (int i = 0; i < count; ++i) {
+        datagrams[i].resize(1 + i % maxSize);
+        for (auto &c: datagrams[i]) c = (char) rng();
+    }
+    // the server echoes whatever reaches it, which goes back to the client through both gateways
+    std::thread echo([&] {
+        std::vector<char> buffer(UdpGateway::MAX_DATAGRAM);
+        sockaddr_in from{};
+        for (int i = 0; i < count; ++i) {
+            socklen_t length = sizeof(from);
+            auto n = recvfrom(server, buffer.data(), buffer.size(), 0, (sockaddr *) &from, &length);
+            if (n < 0) return;
+            sendto(server, buffer.data(), (size_t) n, 0, (const sockaddr *) &from, length);
+        }
+    });
+    MyTimer timer;
+    // in bursts, so the gateway gets to drain its socket even on one core
+    for (int i = 0; i < count; ++i) {
+        sendTo(client, datagrams[i], node1.gateway->port());
+        if (i % UdpGateway::BATCH == UdpGateway::BATCH - 1) Thread::sleep(1);
+    }
+    int intact = 0;
+    std::vector<char> buffer(UdpGateway::MAX_DATAGRAM);
+    for (auto &datagram: datagrams) {
+        auto n = recv(client, buffer.data(), buffer.size(), 0);
+        if (n < 0) break;
+        intact += std::string(buffer.data(), (size_t) n) == datagram;
+    }
+    auto seconds = timer.duration();
+    echo.join();
+    node1.gateway->stop();
+    node2.gateway->stop();
+    cable.stop();
+    close(client);
+    close(server);
+    size_t bytes = 0;
+    for (auto &datagram: datagrams) bytes += datagram.size();
+    fprintf(stderr, "%d of %d datagrams (%zu bytes) echoed intact in %.2fs, %.0f bps each way\n", intact, count,
+            bytes, seconds, (double) bytes * 8 / seconds);
+    return intact == count ? 0 : 1;
+}
+
+}// namespace
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "selftest")
+        return selfTest(argc > 2 ? argv[2] : "default", argc > 3 ? std::stoi(argv[3]) : 60);
+
+    std::string config = argc > 1 ? argv[1] : "default";
+    auto port = [&](int i, int fallback) { return (uint16_t) (argc > i ? std::stoi(argv[i]) : fallback); };
+    GatewayNode node1, node2;
+    if (!node1.open(config, true, port(2, 9000), port(3, 0)) ||
+        !node2.open(config, false, port(4, 9001), port(5, 9002)))
+        return 1;
+    LoopbackCable cable(node1, node2);
+    fprintf(stderr, "bridging 127.0.0.1:%u <-> 127.0.0.1:%u, close stdin to stop\n", node1.gateway->port(),
+            node2.gateway->port());
+    for (std::string line; std::getline(std::cin, line);) {}
+    node1.gateway->stop();
+    node2.gateway->stop();
+    fprintf(stderr, "node1: %llu datagrams in, %llu out; node2: %llu in, %llu out\n",
+            (unsigned long long) node1.gateway->datagramsIn, (unsigned long long) node1.gateway->datagramsOut,
+            (unsigned long long) node2.gateway->datagramsIn, (unsigned long long) node2.gateway->datagramsOut);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "audio_block.h"
+#include "link.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+/* In-process cable between two nodes, for the tools that run both ends of a link
+ *
+ * A stand-in audio thread calls LinkAudioBlock::process() for both nodes every block, at real-time
+ * pace, exactly like the audio callback of Part3 - Part5; each node hears what the other one
+ * played in the previous block, lane by lane like the two wires of a stereo cable. A shared cable
+ * is one medium like the air: each node hears itself as well, added to the other. The cable runs at
+ * the device rate of the nodes, which their audio blocks resample to that of the link.
+ */
+
+struct LoopbackNode {
+    static constexpr int BLOCK_SIZE = 144;
+    static constexpr double DEVICE_RATE = 48000;
+
+    std::array<SampleRing, MAX_LANES> input;
+    std::array<OutputScheduler, MAX_LANES> output;
+    std::array<Atomic<bool>, MAX_LANES> quiet;
+    LinkStats stats;
+    AudioCapture capture; // never started, push() returns at once
+    static_assert(MAX_LANES == 2, "one LinkAudioBlock per lane");
+    LinkAudioBlock blocks[MAX_LANES]{{input[0], output[0], quiet[0], stats, capture},
+                                     {input[1], output[1], quiet[1], stats, capture}};
+    std::unique_ptr<Link> link;
+    unsigned lanes{1};
+    double deviceRate{DEVICE_RATE};
+
+    // false if there is no configuration called config
+    bool open(const std::string &config, MacMode mode, unsigned laneCount = 1, double rate = DEVICE_RATE) {
+        lanes = std::clamp(laneCount, 1u, MAX_LANES);
+        deviceRate = rate;
+        link = makeLink(config, {input.data(), output.data(), quiet.data(), &stats, lanes}, mode);
+        if (link == nullptr) return false;
+        for (auto &block: blocks) {
+            block.configure(link->carrierSense());
+            block.setRates(deviceRate, link->sampleRate(), BLOCK_SIZE);
+        }
+        return true;
+    }
+};
+
+class LoopbackCable {
+public:
+    static constexpr int BLOCK_SIZE = LoopbackNode::BLOCK_SIZE;
+
+    LoopbackCable(LoopbackNode &node1, LoopbackNode &node2, bool shared = false) {
+        audio = std::thread([this, &node1, &node2, shared] {
+            float block1[MAX_LANES][BLOCK_SIZE]{}, block2[MAX_LANES][BLOCK_SIZE]{};
+            float played1[MAX_LANES][BLOCK_SIZE]{}, played2[MAX_LANES][BLOCK_SIZE]{};
+            auto period = std::chrono::duration<double>(BLOCK_SIZE / node1.deviceRate);
+            auto deadline = std::chrono::steady_clock::now();
+            while (running) {
+                for (unsigned lane = 0; lane < MAX_LANES; ++lane) {
+                    // a lane one of the nodes does not use stays silent
+                    float wired = lane < node1.lanes && lane < node2.lanes ? 1.0f : 0.0f, own = shared ? wired : 0.0f;
+                    for (int i = 0; i < BLOCK_SIZE; ++i) {
+                        block1[lane][i] = wired * played2[lane][i] + own * played1[lane][i];
+                        block2[lane][i] = wired * played1[lane][i] + own * played2[lane][i];
+                    }
+                    if (lane < node1.lanes) node1.blocks[lane].process(block1[lane], BLOCK_SIZE);
+                    if (lane < node2.lanes) node2.blocks[lane].process(block2[lane], BLOCK_SIZE);
+                }
+                std::copy(&block1[0][0], &block1[0][0] + MAX_LANES * BLOCK_SIZE, &played1[0][0]);
+                std::copy(&block2[0][0], &block2[0][0] + MAX_LANES * BLOCK_SIZE, &played2[0][0]);
+                deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+                std::this_thread::sleep_until(deadline);
+            }
+        });
+    }
+
+    LoopbackCable(const LoopbackCable &) = delete;
+
+    ~LoopbackCable() { stop(); }
+
+    void stop() {
+        running = false;
+        if (audio.joinable()) audio.join();
+    }
+
+private:
+    std::atomic<bool> running{true};
+    std::thread audio;
+};
@@ -0,0 +1,93 @@
+#include "capture.h"
+#include "dsp.h"
+#include "frame.h"
+#include "link_config.h"
+#include "pipeline.h"
+#include "pool.h"
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/* Feeds a capture recorded with PROJECT2_CAPTURE through the ReceivePipeline as fast as the CPU allows
+ *
+ * usage: Project2_Replay <capture file> [link configuration]
+ * Prints every delivered frame and a summary with the receiver counters and the speed-up over real time.
+ * A capture at another rate than the configuration's is resampled to it first.
+ */
+
+namespace {
+
+template<class Config>
+void replay(CaptureReader &capture) {
+    SampleRing input;
+    FramePool<Config> pool;
+    FrameQueue<Config> output(pool);
+    LinkStats stats;
+    ReceivePipeline<Config> receiver(&input, &output, &stats);
+    receiver.startThread();
+
+    auto printFrames = [&] {
+        for (FrameHandle<Config> frame; output.pop(frame);)
+            printf("frame len = %u, seq = %d\n", frame->len, frame->seq);
+    };
+
+    auto captureRate = (unsigned) std::lround(capture.sampleRate());
+    std::unique_ptr<dsp::Resampler> resampler;
+    if (captureRate != Config::SAMPLE_RATE)
+        resampler = std::make_unique<dsp::Resampler>(captureRate, Config::SAMPLE_RATE);
+
+    MyTimer wallTime;
+    CaptureBlock block{};
+    std::vector<float> data, resampled;
+    uint64_t firstTimestamp = 0, lastTimestamp = 0, totalSamples = 0, blocks = 0;
+    while (capture.next(block, data)) {
+        if (blocks++ == 0) firstTimestamp = block.timestamp;
+        lastTimestamp = block.timestamp;
+        totalSamples += block.numSamples;
+        if (resampler) {
+            resampled.resize(resampler->outputsFor(data.size()));
+            resampled.resize(resampler->process(data.data(), data.size(), resampled.data()));
+            data.swap(resampled);
+        }
+        // keep the queue short, the detector pays for every sample it has to skip past
+        while (input.size() > (1 << 16)) Thread::yield();
+        for (size_t pushed = 0; (pushed += input.push(data.data() + pushed, data.size() - pushed)) < data.size();)
+            Thread::yield();
+        printFrames();
+    }
+    while (input.size() > 0) Thread::yield();
+    Thread::sleep(10);
+    receiver.stopThread(1000);
+    printFrames();
+
+    auto seconds = wallTime.duration();
+    auto recorded = (double) totalSamples / capture.sampleRate();
+    auto snapshot = stats.snapshot();
+    fprintf(stderr, "%llu blocks, %.2fs of audio (%.2fs wall clock while recording) replayed in %.3fs, %.0fx real time\n",
+            (unsigned long long) blocks, recorded, (double) (lastTimestamp - firstTimestamp) * 1e-9, seconds,
+            recorded / seconds);
+    fprintf(stderr, "preambles %llu, length discards %llu, CRC failures %llu, delivered %llu\n",
+            (unsigned long long) snapshot.preamblesDetected, (unsigned long long) snapshot.lengthDiscards,
+            (unsigned long long) snapshot.crcFailures, (unsigned long long) snapshot.framesDelivered);
+}
+
+}// namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: Project2_Replay <capture file> [%s]\n", LINK_CONFIG_NAMES);
+        return 1;
+    }
+    CaptureReader capture(argv[1]);
+    if (!capture.isOpen()) {
+        fprintf(stderr, "failed to open %s!\n", argv[1]);
+        return 1;
+    }
+    if (!withLinkConfig(argc > 2 ? argv[2] : "default", [&](auto config) { replay<decltype(config)>(capture); })) {
+        fprintf(stderr, "unknown link configuration %s, use one of: %s\n", argv[2], LINK_CONFIG_NAMES);
+        return 1;
+    }
+    return 0;
+}
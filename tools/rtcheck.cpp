@@ -0,0 +1,225 @@
+#include "link.h"
+#include "loopback.h"
+#include "rtcheck.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+
+/* Real-time safety harness for the audio callback of Part3 - Part5
+ *
+ * usage: Project2_RtCheck [link configuration[/of Node2]] [frames] [mac|socket] [random|text|input] [lanes]
+ *                        [wired|shared] [device rate]
+ * Two links talk over the in-process cable of loopback.h while Node1 and Node2 run the sliding
+ * window transfer against each other. Built with PROJECT2_RT_CHECK=1, so every allocation and
+ * every lock taken inside process() is counted. Afterwards a burst scheduled for a sample in the
+ * middle of a block has to be reported at exactly that sample. Exits with 1 if anything was
+ * flagged, the transfer failed or the burst was off.
+ *
+ * With socket, the nodes stream the data through stream 0 of a LinkSocket instead, written in
+ * pieces of a few frames each, while Node1 pings Node2 on stream 1. With text, the data is words
+ * that compress well, so the goodput shows what transparent compression gains. With input, both
+ * nodes send INPUT.bin from the working directory like Part3 and Part4 do, whatever frames says.
+ * With two configurations like bulk/default, Node2 runs the second one and the handshake has to
+ * settle on what both support. With 2 lanes, both nodes stripe their frames over the two channels
+ * of a stereo cable. With shared, each node hears itself too, like two nodes in the same air. With
+ * a device rate other than that of the link (the default), the cable runs at that rate and the
+ * audio blocks resample; a rate the link does not survive that way is refused, see carriesAt().
+ */
+
+namespace {
+
+constexpr int BLOCK_SIZE = LoopbackCable::BLOCK_SIZE;
+
+struct Node : LoopbackNode {
+    TransferResult result;
+
+    std::vector<double> pings; // round trips on the interactive stream, in seconds
+
+    // Streams data through stream 0 while reading as much back, filling result like transfer()
+    // would; meanwhile Node1 pings on stream 1 and Node2 echoes, to show the bulk does not block them
+    void stream(bool isNode1, const std::string &data, size_t piece) {
+        if (!link->handshake(isNode1, 20)) return;
+        MyTimer timer;
+        auto bulk = link->connect(isNode1, 20, 0);
+        auto interactive = link->connect(isNode1, 20, 1);
+        std::atomic<bool> bulkDone{false};
+        std::thread ping([&] {
+            char message[8]{};
+            size_t got = 0;
+            MyTimer sent;
+            if (isNode1) interactive->write(message, sizeof(message));
+            for (; !bulkDone; Thread::sleep(1)) {
+                got += interactive->tryRead(message + got, sizeof(message) - got);
+                if (got < sizeof(message)) continue;
+                if (isNode1) {
+                    pings.push_back(sent.duration());
+                    Thread::sleep(100);
+                    sent.restart();
+                }
+                interactive->write(message, sizeof(message));
+                got = 0;
+            }
+        });
+        auto received = bulk->readAsync(data.size());
+        std::vector<std::future<bool>> writes;
+        for (size_t pos = 0; pos < data.size(); pos += piece) writes.push_back(bulk->writeAsync(data.substr(pos, piece)));
+        result.received = received.get();
+        result.receiveSeconds = timer.duration();
+        result.receiveAll = result.received.size() == data.size();
+        result.receivedOnAir = result.received.size();
+        result.ACKedAll = true;
+        for (auto &write: writes) result.ACKedAll = write.get() && result.ACKedAll;
+        result.totalSeconds = timer.duration();
+        // the last ACKs may still be on their way to the other node
+        Thread::sleep(1000);
+        bulkDone = true;
+        ping.join();
+        bulk->close();
+        interactive->close();
+    }
+};
+
+std::string randomData(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::string ret;
+    for (size_t i = 0; i < size; ++i) ret.push_back((char) (rng() & 0x7f));
+    return ret;
+}
+
+std::string textData(size_t size, uint32_t seed) {
+    static const char *words[] = {"the ", "frame ", "is ", "acknowledged ", "after ", "a ", "timeout ", "and ",
+                                  "sent ", "again ", "at ", "the ", "base ", "rate.\n"};
+    std::mt19937 rng(seed);
+    std::string ret;
+    while (ret.size() < size) ret += words[rng() % std::size(words)];
+    ret.resize(size);
+    return ret;
+}
+
+// The whole file, empty if it cannot be read
+std::string readFile(const char *path) {
+    std::ifstream fIn(path, std::ios::binary | std::ios::in);
+    std::string ret;
+    for (char c; fIn.get(c);) ret.push_back(c);
+    return ret;
+}
+
+}// namespace
+
+int main(int argc, char **argv) {
+    std::string config = argc > 1 ? argv[1] : "default";
+    auto slash = config.find('/');
+    std::string config2 = slash == std::string::npos ? config : config.substr(slash + 1);
+    config = config.substr(0, slash);
+    int frames = argc > 2 ? std::stoi(argv[2]) : 20;
+    auto mode = MacMode::Csma;
+    bool socket = argc > 3 && std::string(argv[3]) == "socket";
+    if (argc > 3 && !socket && !parseMacMode(argv[3], mode)) {
+        fprintf(stderr, "unknown MAC %s, use one of: %s\n", argv[3], MAC_MODE_NAMES);
+        return 1;
+    }
+    std::string payload = argc > 4 ? argv[4] : "random";
+    unsigned lanes = argc > 5 ? (unsigned) std::stoi(argv[5]) : 1;
+    bool shared = argc > 6 && std::string(argv[6]) == "shared";
+    double deviceRate = argc > 7 ? std::stod(argv[7]) : (double) linkSampleRate(config);
+    if (!rtcheck::enabled) fprintf(stderr, "built without PROJECT2_RT_CHECK, nothing will be flagged\n");
+
+    Node node1, node2;
+    if (!node1.open(config, mode, lanes, deviceRate) || !node2.open(config2, mode, lanes, deviceRate)) {
+        fprintf(stderr, "unknown link configuration %s/%s, use one of: %s\n", config.c_str(), config2.c_str(),
+                LINK_CONFIG_NAMES);
+        return 1;
+    }
+    for (auto node: {&node1, &node2})
+        if (!carriesAt(*node->link, deviceRate)) {
+            fprintf(stderr, "the link at %.0f Hz does not survive resampling to a cable at %.0f Hz\n",
+                    node->link->sampleRate(), deviceRate);
+            return 1;
+        }
+    // a node that never hears the other waits for it forever; give up long after any transfer is done
+    std::thread([limit = 60 + std::max(frames, 0)] {
+        std::this_thread::sleep_for(std::chrono::seconds(limit));
+        fprintf(stderr, "no result after %ds, giving up\n", limit);
+        std::_Exit(1);
+    }).detach();
+    // frames of the size both can take
+    auto maxBody = std::min(node1.link->maxBodyLength(), node2.link->maxBodyLength());
+    auto makeData = payload == "text" ? textData : randomData;
+    auto data1 = makeData(frames * maxBody, 1);
+    auto data2 = makeData(frames * maxBody, 2);
+    if (payload == "input") {
+        data1 = data2 = readFile("INPUT.bin");
+        if (data1.empty()) {
+            fprintf(stderr, "failed to open INPUT.bin!\n");
+            return 1;
+        }
+    }
+
+    LoopbackCable cable(node1, node2, shared);
+
+    rtcheck::reset();
+    if (socket) {
+        auto piece = 3 * maxBody;
+        std::thread mac2([&] { node2.stream(false, data2, piece); });
+        node1.stream(true, data1, piece);
+        mac2.join();
+    } else {
+        std::thread mac2([&] { node2.result = node2.link->transfer(false, data2, 20); });
+        node1.result = node1.link->transfer(true, data1, 20);
+        mac2.join();
+    }
+
+    // Both MACs are done, so nobody else schedules on node1 or polls its reports now
+    std::vector<float> burst(BLOCK_SIZE * 3 / 2, 0.5f);
+    uint64_t at = node1.output[0].now() + (uint64_t) node1.link->sampleRate() / 10 + BLOCK_SIZE / 3, id = 0;
+    bool onTime = node1.output[0].schedule(burst.data(), burst.size(), at, id);
+    TransmissionReport report;
+    for (MyTimer wait; onTime && report.id != id && wait.duration() < 1;)
+        if (!node1.output[0].popReport(report)) Thread::sleep(1);
+    onTime = onTime && report.id == id && report.start == at && report.end == at + burst.size();
+    auto agreed = node1.link->agreed();
+    cable.stop();
+    node1.link.reset();
+    node2.link.reset();
+
+    bool delivered = node1.result.receiveAll && node1.result.received == data2 &&
+                     node2.result.receiveAll && node2.result.received == data1;
+    auto seconds = std::max(node1.result.totalSeconds, node2.result.totalSeconds);
+    fprintf(stderr, "transfer %s in %.2fs (%.0f bps both ways), resent %llu + %llu frames\n",
+            delivered ? "complete" : "FAILED", seconds, (double) (data1.size() + data2.size()) * 8 / seconds,
+            (unsigned long long) node1.stats.snapshot().framesResent,
+            (unsigned long long) node2.stats.snapshot().framesResent);
+    fprintf(stderr, "agreed on %u byte frames, window %u, %u streams, %u lanes, bit lengths 0x%x\n",
+            agreed.maxBody, agreed.window, agreed.streams, agreed.lanes, agreed.rates);
+    fprintf(stderr, "goodput %.0f + %.0f bps, %zu + %zu bytes on air for %zu + %zu\n", node1.result.goodput(),
+            node2.result.goodput(), node1.result.receivedOnAir, node2.result.receivedOnAir, data2.size(),
+            data1.size());
+    if (!node1.pings.empty()) {
+        auto worst = *std::max_element(node1.pings.begin(), node1.pings.end());
+        fprintf(stderr, "%zu pings on stream 1 next to the bulk, worst round trip %.0fms\n", node1.pings.size(),
+                worst * 1000);
+    }
+    fprintf(stderr, "node1 latency (count, p50/p99/max us):");
+#define X(name, side) { \
+        auto summary = node1.stats.latency.name.summary(); \
+        fprintf(stderr, "\n    %-13s %6llu  %llu/%llu/%llu", #name, (unsigned long long) summary.count, \
+                (unsigned long long) summary.p50, (unsigned long long) summary.p99, \
+                (unsigned long long) summary.max); \
+    }
+    LINK_LATENCY_STAGES(X)
+#undef X
+    fprintf(stderr, "\n");
+    fprintf(stderr, "burst scheduled for sample %llu played at %llu..%llu%s\n", (unsigned long long) at,
+            (unsigned long long) report.start, (unsigned long long) report.end, onTime ? "" : ", WRONG");
+    bool clean = rtcheck::report(stderr);
+    return delivered && onTime && clean ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "channel.h"
+#include "frame.h"
+#include "link_config.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "reader.h"
+#include "writer.h"
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/* Offline link simulator
+ *
+ * Sends random frames through Writer::send -> Channel -> Reader::run without any audio device and
+ * prints one CSV row per SNR point:
+ *   snr_db, ber, fer, frames, delivered, realtime_factor
+ * BER is measured genie-aided (judgeBit on the known sample positions), FER through the real receiver,
+ * the ReceivePipeline unless --decoders 0 picks the single-threaded Reader.
+ */
+
+namespace {
+
+struct Options {
+    ChannelConfig channel;
+    double snrFrom = 0, snrTo = 20, snrStep = 2;
+    int frames = 200;
+    unsigned gap = 480; // idle samples between two frames
+    std::string config = "default";
+    int decoders = -1; // -1: one per spare core, 0: the single-threaded Reader
+    unsigned bitLength = 0; // samples per bit of the payload, 0: the base rate of the configuration
+};
+
+void usage() {
+    fprintf(stderr, "usage: Project2_Simulate [--snr from:to:step] [--frames n] [--gain g] [--taps a,b,...]\n"
+                    "                         [--delay samples] [--drift ppm] [--jamming amplitude] [--dc offset]\n"
+                    "                         [--seed s] [--config %s] [--decoders n] [--rate samples per bit]\n", LINK_CONFIG_NAMES);
+}
+
+bool parse(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--snr") {
+            if (sscanf(value.c_str(), "%lf:%lf:%lf", &opt.snrFrom, &opt.snrTo, &opt.snrStep) != 3) return false;
+        } else if (arg == "--frames") {
+            opt.frames = std::stoi(value);
+        } else if (arg == "--gain") {
+            opt.channel.gain = std::stof(value);
+        } else if (arg == "--taps") {
+            opt.channel.taps.clear();
+            for (size_t pos = 0; pos != std::string::npos;) {
+                auto next = value.find(',', pos);
+                opt.channel.taps.push_back(std::stof(value.substr(pos, next - pos)));
+                pos = next == std::string::npos ? next : next + 1;
+            }
+        } else if (arg == "--delay") {
+            opt.channel.delaySamples = (unsigned) std::stoul(value);
+        } else if (arg == "--drift") {
+            opt.channel.driftPpm = std::stod(value);
+        } else if (arg == "--jamming") {
+            opt.channel.jammingAmplitude = std::stof(value);
+        } else if (arg == "--dc") {
+            opt.channel.dcOffset = std::stof(value);
+        } else if (arg == "--seed") {
+            opt.channel.seed = (uint32_t) std::stoul(value);
+        } else if (arg == "--config") {
+            opt.config = value;
+        } else if (arg == "--decoders") {
+            opt.decoders = std::stoi(value);
+        } else if (arg == "--rate") {
+            opt.bitLength = (unsigned) std::stoul(value);
+        } else {
+            return false;
+        }
+    }
+    return opt.snrStep > 0 && opt.frames > 0;
+}
+
+// Plays everything the Writer queued, back to back
+std::vector<float> drain(OutputScheduler &output) {
+    std::vector<float> ret(output.backlog());
+    output.render(ret.data(), ret.size());
+    return ret;
+}
+
+// Blocks until the receiver made room for all of data
+void feed(SampleRing &ring, const std::vector<float> &data) {
+    for (size_t pushed = 0; (pushed += ring.push(data.data() + pushed, data.size() - pushed)) < data.size();)
+        Thread::yield();
+}
+
+template<class Config>
+void runPoint(const Options &opt, double snrDb) {
+    using Frame = FrameType<Config>;
+    auto bitLength = opt.bitLength ? opt.bitLength : Config::LENGTH_OF_ONE_BIT;
+    if (!Config::isPayloadBitLength(bitLength)) {
+        fprintf(stderr, "--rate has to be even and at most %u\n", Config::LENGTH_OF_ONE_BIT);
+        return;
+    }
+    ChannelConfig cfg = opt.channel;
+    cfg.snrDb = snrDb;
+    Channel channel(cfg);
+    std::mt19937 rng(cfg.seed);
+
+    OutputScheduler txRing;
+    SampleRing rxRing;
+    FramePool<Config> pool;
+    FrameQueue<Config> delivered(pool);
+    Atomic<bool> quiet = true;
+    LinkStats stats;
+    Writer<Config> writer(&txRing, &quiet, &stats);
+    std::unique_ptr<Reader<Config>> reader;
+    std::unique_ptr<ReceivePipeline<Config>> pipeline;
+    if (opt.decoders == 0) {
+        reader = std::make_unique<Reader<Config>>(&rxRing, &delivered, &stats);
+        reader->startThread();
+    } else {
+        pipeline = std::make_unique<ReceivePipeline<Config>>(&rxRing, &delivered, &stats,
+                                                             (unsigned) std::max(opt.decoders, 0));
+        pipeline->startThread();
+    }
+
+    MyTimer wallTime;
+    std::vector<Frame> sent;
+    // match deliveries in order as they come, a frame counts only if it is bit exact
+    int good = 0;
+    size_t next = 0;
+    auto match = [&] {
+        for (FrameHandle<Config> frame; delivered.pop(frame);) {
+            auto str = frame->wholeString();
+            for (auto i = next; i < sent.size(); ++i)
+                if (sent[i].wholeString() == str) {
+                    ++good;
+                    next = i + 1;
+                    break;
+                }
+        }
+    };
+    std::vector<float> rx;
+    double txPosition = 0; // transmitter sample clock
+    double rxPosition = 0; // receiver samples handed to the Reader before the current batch
+    long long bitErrors = 0, bits = 0;
+    for (int n = 0; n < opt.frames; ++n) {
+        char body[Config::MAX_LENGTH_BODY];
+        for (auto &c: body) c = (char) (rng() & 0xff);
+        sent.emplace_back((typename Config::LENType) Config::MAX_LENGTH_BODY, (typename Config::SEQType) (n % 127 + 1), body);
+        sent.back().bitLength = (unsigned char) bitLength;
+        writer.send(sent.back());
+        auto tx = drain(txRing);
+
+        rx.clear();
+        channel.idle(opt.gap, rx);
+        txPosition += opt.gap;
+        channel.process(tx.data(), tx.size(), rx);
+        // genie-aided slicing at the sample positions the receiver would see for this frame, relative
+        // to the level a preamble would have after the channel gain, like the receiver does
+        auto threshold = sliceThreshold<Config>(2.0f * std::fabs(cfg.gain));
+        auto bytes = std::string(Config::preamble, Config::LENGTH_PREAMBLE) + sent.back().wholeString() + inString(sent.back().crc());
+        for (size_t bit = 0; bit < bytes.size() * 8; ++bit) {
+            // sample the middle of each half bit, so drift never pushes us across a transition
+            constexpr size_t HEADER_BITS = Config::OFFSET_BODY * 8;
+            auto length = bit < HEADER_BITS ? Config::LENGTH_OF_ONE_BIT : bitLength;
+            auto start = bit < HEADER_BITS ? bit * Config::LENGTH_OF_ONE_BIT
+                                           : HEADER_BITS * Config::LENGTH_OF_ONE_BIT + (bit - HEADER_BITS) * bitLength;
+            auto at = [&](double offset) {
+                auto txIndex = txPosition + (double) start + offset * length;
+                auto index = (long long) std::lround(txIndex / (1.0 + cfg.driftPpm * 1e-6) + cfg.delaySamples - rxPosition);
+                return index >= 0 && index < (long long) rx.size() ? rx[index] : 0.0f;
+            };
+            bitErrors += judgeBit(at(0.125), at(0.625), threshold) != (bytes[bit / 8] >> (bit % 8) & 1);
+            ++bits;
+        }
+        txPosition += (double) tx.size();
+        rxPosition += (double) rx.size();
+
+        feed(rxRing, rx);
+        match();
+    }
+    // flush the last frame out of the channel and wait for the Reader to catch up
+    rx.clear();
+    channel.idle(cfg.delaySamples + Config::frameSamples(Config::MAX_LENGTH_BODY), rx);
+    feed(rxRing, rx);
+    while (!rxRing.empty()) Thread::sleep(1);
+    Thread::sleep(10);
+    if (reader) reader->stopThread(1000);
+    if (pipeline) pipeline->stopThread(1000);
+    match();
+    auto seconds = wallTime.duration();
+    printf("%.1f,%.3e,%.4f,%d,%d,%.1f\n", snrDb, (double) bitErrors / (double) bits,
+           1.0 - (double) good / opt.frames, opt.frames, good, txPosition / cfg.sampleRate / seconds);
+    fflush(stdout);
+}
+
+}// namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse(argc, argv, opt)) {
+        usage();
+        return 1;
+    }
+    bool known = withLinkConfig(opt.config, [&](auto config) {
+        printf("snr_db,ber,fer,frames,delivered,realtime_factor\n");
+        for (double snr = opt.snrFrom; snr <= opt.snrTo + 1e-9; snr += opt.snrStep)
+            runPoint<decltype(config)>(opt, snr);
+    });
+    if (!known) {
+        usage();
+        return 1;
+    }
+    return 0;
+}
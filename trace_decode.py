@@ -0,0 +1,71 @@
+import struct
+import sys
+
+# Keep in sync with trace::Event in common/trace.h
+EVENT_NAMES = [
+    "ThreadName",
+    "Dropped",
+    "PreambleDetected",
+    "DiscardLength",
+    "DiscardCRC",
+    "FrameDelivered",
+    "WriterDefer",
+    "WriterQueued",
+    "FrameSent",
+    "FrameResent",
+    "FrameReceived",
+    "AckSent",
+    "AckReceived",
+    "LinkError",
+    "PingSent",
+    "PingReply",
+    "PingTimeout",
+    "ChannelEmpty",
+    "CandidateOverrun",
+    "CandidateDropped",
+    "DuplicateFrame",
+    "TransmissionDone",
+    "Beacon",
+    "TurnPlanned",
+    "RateChanged",
+    "CreditGranted",
+    "CreditStalled",
+    "FrameDropped",
+    "NackSent",
+    "FastRetransmit",
+    "Handshake",
+]
+
+RECORD = struct.Struct("<QHHiii")
+
+path = sys.argv[1] if len(sys.argv) > 1 else "trace.bin"
+with open(path, "rb") as file:
+    if file.read(8) != b"P2TRACE1":
+        print(f"{path} is not a trace file")
+        exit(1)
+    data = file.read()
+
+threads = {}
+records = []
+for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+    timestamp, event, thread, a, b, c = RECORD.unpack_from(data, offset)
+    if event == 0:
+        threads[thread] = struct.pack("<iii", a, b, c).rstrip(b"\0").decode(errors="replace")
+    elif event == 1:
+        print(f"Warning: {a} records dropped by thread {b}")
+    else:
+        records.append((timestamp, thread, event, a, b, c))
+
+records.sort()
+if not records:
+    print("No events recorded")
+    exit(0)
+
+begin = records[0][0]
+last = {}
+for timestamp, thread, event, a, b, c in records:
+    name = EVENT_NAMES[event] if event < len(EVENT_NAMES) else f"Event{event}"
+    delta = (timestamp - last[thread]) / 1e3 if thread in last else 0.0
+    last[thread] = timestamp
+    print(f"{(timestamp - begin) / 1e6:12.3f}ms  +{delta:10.1f}us  {threads.get(thread, thread)!s:>12}  "
+          f"{name:<16} {a:6d} {b:6d} {c:8d}")